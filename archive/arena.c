@@ -0,0 +1,55 @@
+#define _GNU_SOURCE
+#include <sys/mman.h>
+
+#include "vk.h"
+
+memory_arena create_arena(memory_index reserve_size)
+{
+   memory_arena result = {0};
+
+   // NOTE: Nothing in the reservation is accessible until it is committed.
+   reserve_size = (reserve_size + ARENA_COMMIT_BLOCK_SIZE - 1) & ~(memory_index)(ARENA_COMMIT_BLOCK_SIZE - 1);
+   void *base = mmap(0, reserve_size, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+   if(base == MAP_FAILED)
+   {
+      fprintf(stderr, "Error: Failed to reserve %td bytes of address space.\n", reserve_size);
+      exit(1);
+   }
+
+   result.base = base;
+   result.reserved = reserve_size;
+
+   return(result);
+}
+
+void destroy_arena(memory_arena *arena)
+{
+   if(arena->base)
+   {
+      munmap(arena->base, arena->reserved);
+   }
+   memset(arena, 0, sizeof(*arena));
+}
+
+void commit_arena(memory_arena *arena, memory_index size)
+{
+   if(size > arena->reserved)
+   {
+      fprintf(stderr, "Error: Arena reservation of %td bytes exhausted (%td requested).\n", arena->reserved, size);
+      assert(0);
+      exit(1);
+   }
+
+   memory_index new_committed = (size + ARENA_COMMIT_BLOCK_SIZE - 1) & ~(memory_index)(ARENA_COMMIT_BLOCK_SIZE - 1);
+   if(new_committed > arena->reserved)
+   {
+      new_committed = arena->reserved;
+   }
+
+   if(mprotect(arena->base + arena->committed, new_committed - arena->committed, PROT_READ|PROT_WRITE) != 0)
+   {
+      fprintf(stderr, "Error: Failed to commit %td bytes of arena memory.\n", new_committed - arena->committed);
+      exit(1);
+   }
+   arena->committed = new_committed;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+// NOTE: Arenas reserve a large range of address space up front and commit it
+// in blocks as allocations reach it, so they can grow without ever moving and
+// only cost physical memory for what has actually been touched.
+
+#define ARENA_COMMIT_BLOCK_SIZE (64*1024)
+
+typedef struct {
+   char *base;
+   memory_index used;
+   memory_index committed;
+   memory_index reserved;
+   memory_index high_water;
+   u32 temp_count;
+} memory_arena;
+
+typedef struct {
+   memory_arena *arena;
+   memory_index used;
+} temporary_memory;
+
+EXTERN_C memory_arena create_arena(memory_index reserve_size);
+EXTERN_C void destroy_arena(memory_arena *arena);
+EXTERN_C void commit_arena(memory_arena *arena, memory_index size);
+
+#define allocate(arena, count, type) (type *)allocate_(arena, count, sizeof(type), _Alignof(type))
+
+static inline void *allocate_(memory_arena *arena, memory_index count, memory_index size, memory_index alignment)
+{
+    memory_index padding = -(uintptr_t)(arena->base + arena->used) & (alignment - 1);
+    memory_index new_used = arena->used + padding + count*size;
+    if(new_used > arena->committed)
+    {
+       commit_arena(arena, new_used);
+    }
+
+    void *result = arena->base + arena->used + padding;
+    arena->used = new_used;
+    if(new_used > arena->high_water)
+    {
+       arena->high_water = new_used;
+    }
+
+    return memset(result, 0, count*size);
+}
+
+static inline void reset_arena(memory_arena *arena)
+{
+   assert(arena->temp_count == 0);
+   arena->used = 0;
+}
+
+static inline temporary_memory begin_temp(memory_arena *arena)
+{
+   temporary_memory result;
+   result.arena = arena;
+   result.used = arena->used;
+   arena->temp_count++;
+
+   return(result);
+}
+
+static inline void end_temp(temporary_memory temp)
+{
+   assert(temp.arena->used >= temp.used);
+   assert(temp.arena->temp_count > 0);
+
+   temp.arena->used = temp.used;
+   temp.arena->temp_count--;
+}
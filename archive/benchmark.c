@@ -0,0 +1,598 @@
+#define _GNU_SOURCE
+#include <time.h>
+
+#include "benchmark.h"
+#include "culling.h"
+#include "descriptor_allocator.h"
+#include "gpu_primitives.h"
+#include "host_allocator.h"
+#include "immediate.h"
+#include "jobs.h"
+#include "memory_budget.h"
+
+static double get_seconds(void)
+{
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+
+   return(now.tv_sec + now.tv_nsec*1e-9);
+}
+
+typedef struct {
+   FILE *json;
+   u32 entry_count;
+} benchmark_report;
+
+static void begin_benchmark_entry(benchmark_report *report)
+{
+   fprintf(report->json, (report->entry_count++ > 0) ? ",\n    " : "    ");
+}
+
+static u32 random_u32(u32 *state)
+{
+   // NOTE: xorshift32, so runs are repeatable.
+   u32 x = *state;
+   x ^= x << 13;
+   x ^= x >> 17;
+   x ^= x << 5;
+   *state = x;
+
+   return(x);
+}
+
+static float random_unilateral(u32 *state)
+{
+   return((random_u32(state) >> 8) * (1.0f / 16777216.0f));
+}
+
+static void scatter_culling_bounds(culling_bounds *bounds, u32 object_count)
+{
+   // NOTE: Scatter objects over a volume larger than the clip box, so most of
+   // them are culled.
+   u32 random_state = 0x12345678;
+   for(u32 index = 0; index < object_count; ++index)
+   {
+      vec3 center;
+      center.x = 4*random_unilateral(&random_state) - 2;
+      center.y = 4*random_unilateral(&random_state) - 2;
+      center.z = 2*random_unilateral(&random_state) - 0.5f;
+
+      if(index & 1)
+      {
+         set_culling_sphere(bounds, index, center, 0.05f*random_unilateral(&random_state));
+      }
+      else
+      {
+         mat4 identity = {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1}};
+         vec3 extent = {0.05f, 0.05f, 0.05f};
+         set_culling_box(bounds, index, identity, center, extent);
+      }
+   }
+}
+
+static void benchmark_culling(benchmark_report *report, u32 object_count, u32 iteration_count)
+{
+   memory_index arena_size = 8*(object_count + 8)*sizeof(float) + CULLING_CHUNK_SIZE*sizeof(u32) + 1024;
+   memory_arena arena = create_arena(arena_size);
+
+   culling_bounds bounds;
+   initialize_culling_bounds(&bounds, &arena, object_count);
+   u32 *visible = allocate(&arena, bounds.capacity, u32);
+
+   scatter_culling_bounds(&bounds, object_count);
+
+   mat4 view_projection = {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1}};
+   culling_frustum frustum = extract_culling_frustum(view_projection);
+
+   char *variant_names[] = {"scalar", "avx2"};
+   for(int variant = 0; variant < countof(variant_names); ++variant)
+   {
+      bounds.disable_simd = (variant == 0);
+      if(variant == 1 && !__builtin_cpu_supports("avx2"))
+      {
+         continue;
+      }
+
+      u32 visible_count = 0;
+      double best_seconds = 1e9;
+      double total_seconds = 0;
+      for(u32 iteration = 0; iteration < iteration_count; ++iteration)
+      {
+         double start = get_seconds();
+         visible_count = cull_bounds(&bounds, &frustum, visible);
+         double elapsed = get_seconds() - start;
+
+         total_seconds += elapsed;
+         if(elapsed < best_seconds) best_seconds = elapsed;
+      }
+
+      begin_benchmark_entry(report);
+      fprintf(report->json, "{\"name\": \"culling_%s\", \"objects\": %u, \"threads\": %u, \"iterations\": %u, "
+              "\"visible\": %u, \"best_ms\": %.4f, \"average_ms\": %.4f, \"objects_per_second\": %.0f}",
+              variant_names[variant], object_count, get_job_thread_count(), iteration_count,
+              visible_count, best_seconds*1000.0, total_seconds*1000.0/iteration_count,
+              object_count/best_seconds);
+   }
+
+   destroy_arena(&arena);
+}
+
+typedef struct {
+   u32 remaining_depth;
+} spawn_job_data;
+
+static void spawn_jobs(void *data)
+{
+   // NOTE: Each job spawns two children and waits on them, so the tree
+   // exercises counters, stealing and waiting threads running other jobs.
+   spawn_job_data *job = data;
+   if(job->remaining_depth > 0)
+   {
+      job_counter counter = {0};
+      spawn_job_data children[2] = {{job->remaining_depth - 1}, {job->remaining_depth - 1}};
+      run_job(&counter, spawn_jobs, children + 0);
+      run_job(&counter, spawn_jobs, children + 1);
+      wait_for_counter(&counter);
+   }
+}
+
+static void benchmark_job_scaling(benchmark_report *report, u32 object_count, u32 iteration_count)
+{
+   memory_index arena_size = 8*(object_count + 8)*sizeof(float) + CULLING_CHUNK_SIZE*sizeof(u32) + 1024;
+   memory_arena arena = create_arena(arena_size);
+
+   culling_bounds bounds;
+   initialize_culling_bounds(&bounds, &arena, object_count);
+   u32 *visible = allocate(&arena, bounds.capacity, u32);
+
+   scatter_culling_bounds(&bounds, object_count);
+   bounds.disable_simd = 1;
+
+   mat4 view_projection = {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1}};
+   culling_frustum frustum = extract_culling_frustum(view_projection);
+
+   // NOTE: Restart the job system at every thread count from one up to the
+   // count it was running with, then put it back.
+   u32 spawn_depth = 14;
+   u32 spawn_job_count = (2u << spawn_depth) - 1;
+   u32 max_thread_count = get_job_thread_count();
+   double single_thread_seconds = 0;
+
+   for(u32 thread_count = 1; thread_count <= max_thread_count; ++thread_count)
+   {
+      deinitialize_jobs();
+      initialize_jobs(thread_count);
+
+      double best_cull_seconds = 1e9;
+      double best_spawn_seconds = 1e9;
+      for(u32 iteration = 0; iteration < iteration_count; ++iteration)
+      {
+         double start = get_seconds();
+         cull_bounds(&bounds, &frustum, visible);
+         double elapsed = get_seconds() - start;
+         if(elapsed < best_cull_seconds) best_cull_seconds = elapsed;
+
+         start = get_seconds();
+         spawn_job_data root = {spawn_depth};
+         job_counter counter = {0};
+         run_job(&counter, spawn_jobs, &root);
+         wait_for_counter(&counter);
+         elapsed = get_seconds() - start;
+         if(elapsed < best_spawn_seconds) best_spawn_seconds = elapsed;
+      }
+
+      if(thread_count == 1)
+      {
+         single_thread_seconds = best_cull_seconds;
+      }
+
+      begin_benchmark_entry(report);
+      fprintf(report->json, "{\"name\": \"job_scaling\", \"objects\": %u, \"threads\": %u, \"iterations\": %u, "
+              "\"culling_best_ms\": %.4f, \"speedup\": %.2f, \"efficiency\": %.2f, "
+              "\"spawned_jobs\": %u, \"jobs_per_second\": %.0f}",
+              object_count, thread_count, iteration_count,
+              best_cull_seconds*1000.0, single_thread_seconds/best_cull_seconds,
+              single_thread_seconds/(best_cull_seconds*thread_count),
+              spawn_job_count, spawn_job_count/best_spawn_seconds);
+   }
+
+   if(get_job_thread_count() != max_thread_count)
+   {
+      deinitialize_jobs();
+      initialize_jobs(max_thread_count);
+   }
+
+   destroy_arena(&arena);
+}
+
+typedef enum {
+   GPU_PRIMITIVE_SCAN,
+   GPU_PRIMITIVE_COMPACTION,
+   GPU_PRIMITIVE_SORT_32,
+   GPU_PRIMITIVE_SORT_64,
+
+   GPU_PRIMITIVE_COUNT,
+} gpu_primitive_kind;
+
+typedef struct {
+   u64 key;
+   u32 value;
+} sort_reference;
+
+static int compare_sort_references(const void *a, const void *b)
+{
+   // NOTE: Values are the original indices, so ordering equal keys by value
+   // gives the order a stable sort has to produce.
+   const sort_reference *left = a;
+   const sort_reference *right = b;
+   if(left->key != right->key) return((left->key < right->key) ? -1 : 1);
+   if(left->value != right->value) return((left->value < right->value) ? -1 : 1);
+   return(0);
+}
+
+// NOTE: Where each input lives in the upload buffer, and in the device buffer
+// it is copied to before every run.
+typedef struct {
+   VkDeviceSize keys_64;
+   VkDeviceSize keys_32;
+   VkDeviceSize values;
+   VkDeviceSize scan_input;
+   VkDeviceSize flags;
+   VkDeviceSize size;
+} gpu_primitive_layout;
+
+static b32 check_gpu_primitive(gpu_primitive_kind kind, u32 count, u8 *input, gpu_primitive_layout *layout, u8 *output, memory_arena *arena)
+{
+   b32 result = 1;
+   temporary_memory temp = begin_temp(arena);
+
+   u32 *values = (u32 *)(input + layout->values);
+   if(kind == GPU_PRIMITIVE_SCAN)
+   {
+      u32 *scan_input = (u32 *)(input + layout->scan_input);
+      u32 *scanned = (u32 *)output;
+      u32 sum = 0;
+      for(u32 index = 0; index < count && result; ++index)
+      {
+         result = (scanned[index] == sum);
+         sum += scan_input[index];
+      }
+      result = result && (scanned[count] == sum);
+   }
+   else if(kind == GPU_PRIMITIVE_COMPACTION)
+   {
+      u32 *flags = (u32 *)(input + layout->flags);
+      u32 *compacted = (u32 *)output;
+      u32 kept = 0;
+      for(u32 index = 0; index < count && result; ++index)
+      {
+         if(flags[index])
+         {
+            result = (compacted[kept++] == values[index]);
+         }
+      }
+      result = result && (compacted[count] == kept);
+   }
+   else
+   {
+      b32 wide = (kind == GPU_PRIMITIVE_SORT_64);
+      sort_reference *expected = allocate(arena, count, sort_reference);
+      for(u32 index = 0; index < count; ++index)
+      {
+         expected[index].key = wide ? ((u64 *)(input + layout->keys_64))[index] : ((u32 *)(input + layout->keys_32))[index];
+         expected[index].value = values[index];
+      }
+      qsort(expected, count, sizeof(*expected), compare_sort_references);
+
+      u32 *sorted_values = (u32 *)(output + count*(wide ? sizeof(u64) : sizeof(u32)));
+      for(u32 index = 0; index < count && result; ++index)
+      {
+         u64 key = wide ? ((u64 *)output)[index] : ((u32 *)output)[index];
+         result = (key == expected[index].key && sorted_values[index] == expected[index].value);
+      }
+   }
+
+   end_temp(temp);
+   return(result);
+}
+
+static void benchmark_gpu_primitives(benchmark_report *report, vulkan_context *vk, gpu_primitives *primitives, u32 count, u32 iteration_count)
+{
+   gpu_primitive_layout layout = {0};
+   layout.keys_64 = 0;
+   layout.keys_32 = layout.keys_64 + count*sizeof(u64);
+   layout.values = layout.keys_32 + count*sizeof(u32);
+   layout.scan_input = layout.values + count*sizeof(u32);
+   layout.flags = layout.scan_input + count*sizeof(u32);
+   layout.size = layout.flags + count*sizeof(u32);
+
+   // NOTE: Every output is at most a 64-bit key and a value per element,
+   // followed by a total.
+   VkDeviceSize output_size = count*(sizeof(u64) + sizeof(u32)) + sizeof(u32);
+
+   compute_buffer upload, input, output, readback;
+   create_compute_buffer(&upload, vk->allocator, vk->device, layout.size, VMA_MEMORY_USAGE_CPU_TO_GPU);
+   create_compute_buffer(&input, vk->allocator, vk->device, layout.size, VMA_MEMORY_USAGE_GPU_ONLY);
+   create_compute_buffer(&output, vk->allocator, vk->device, output_size, VMA_MEMORY_USAGE_GPU_ONLY);
+   create_compute_buffer(&readback, vk->allocator, vk->device, output_size, VMA_MEMORY_USAGE_GPU_TO_CPU);
+
+   // NOTE: Small scan inputs keep the total well inside the scan's 30 bits.
+   u8 *data = upload.memory;
+   u32 random_state = 0x9e3779b9;
+   for(u32 index = 0; index < count; ++index)
+   {
+      u64 high = random_u32(&random_state);
+      ((u64 *)(data + layout.keys_64))[index] = (high << 32) | random_u32(&random_state);
+      ((u32 *)(data + layout.keys_32))[index] = random_u32(&random_state);
+      ((u32 *)(data + layout.values))[index] = index;
+      ((u32 *)(data + layout.scan_input))[index] = random_u32(&random_state) & 15;
+      ((u32 *)(data + layout.flags))[index] = random_u32(&random_state) & 1;
+   }
+   VK_CHECK(vmaFlushAllocation(vk->allocator, upload.allocation, 0, VK_WHOLE_SIZE));
+
+   VkQueryPool timestamps = VK_NULL_HANDLE;
+   if(vk->timestamps_supported)
+   {
+      VkQueryPoolCreateInfo query_pool_info = {0};
+      query_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+      query_pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+      query_pool_info.queryCount = 2;
+      VK_CHECK(vkCreateQueryPool(vk->device, &query_pool_info, get_host_allocator(), &timestamps));
+   }
+
+   memory_index arena_size = count*sizeof(sort_reference) + 1024;
+   memory_arena arena = create_arena(arena_size);
+
+   char *kind_names[GPU_PRIMITIVE_COUNT] = {"gpu_scan", "gpu_compaction", "gpu_sort_32", "gpu_sort_64"};
+   for(u32 kind = 0; kind < GPU_PRIMITIVE_COUNT; ++kind)
+   {
+      VkDeviceSize result_size = count*sizeof(u32) + sizeof(u32);
+      if(kind == GPU_PRIMITIVE_SORT_32) result_size = count*(sizeof(u32) + sizeof(u32));
+      if(kind == GPU_PRIMITIVE_SORT_64) result_size = count*(sizeof(u64) + sizeof(u32));
+
+      double best_seconds = 1e9;
+      for(u32 iteration = 0; iteration < iteration_count; ++iteration)
+      {
+         immediate_prepare(vk);
+         VkCommandBuffer cmd = vk->immediate_command_buffer;
+
+         // NOTE: The sort works in place, so every run starts from a fresh
+         // copy of the inputs.
+         VkBufferCopy input_copy = {0, 0, layout.size};
+         vkCmdCopyBuffer(cmd, upload.buffer, input.buffer, 1, &input_copy);
+         record_transfer_barrier(cmd);
+
+         if(timestamps)
+         {
+            vkCmdResetQueryPool(cmd, timestamps, 0, 2);
+            vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, timestamps, 0);
+         }
+
+         command_recorder recorder;
+         begin_recorder(&recorder, cmd);
+         VkDeviceAddress total = output.address + count*sizeof(u32);
+         VkBufferCopy result_copies[2] = {{0, 0, result_size}};
+         u32 result_copy_count = 1;
+         switch(kind)
+         {
+            case GPU_PRIMITIVE_SCAN:
+            {
+               record_exclusive_scan(primitives, vk, &recorder, input.address + layout.scan_input, output.address, total, count);
+            } break;
+
+            case GPU_PRIMITIVE_COMPACTION:
+            {
+               record_stream_compaction(primitives, vk, &recorder, input.address + layout.values, input.address + layout.flags,
+                                        output.address, total, count);
+            } break;
+
+            case GPU_PRIMITIVE_SORT_32:
+            case GPU_PRIMITIVE_SORT_64:
+            {
+               // NOTE: Sorted in the input buffer, from which the keys and
+               // then the values are copied out back to back.
+               b32 wide = (kind == GPU_PRIMITIVE_SORT_64);
+               VkDeviceSize keys = wide ? layout.keys_64 : layout.keys_32;
+               VkDeviceSize key_size = count*(wide ? sizeof(u64) : sizeof(u32));
+               record_radix_sort(primitives, vk, &recorder, input.address + keys, input.address + layout.values, count, wide ? 64 : 32);
+
+               result_copies[0] = (VkBufferCopy){keys, 0, key_size};
+               result_copies[1] = (VkBufferCopy){layout.values, key_size, count*sizeof(u32)};
+               result_copy_count = 2;
+            } break;
+         }
+
+         if(timestamps)
+         {
+            vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, timestamps, 1);
+         }
+
+         b32 sorted = (kind == GPU_PRIMITIVE_SORT_32 || kind == GPU_PRIMITIVE_SORT_64);
+         vkCmdCopyBuffer(cmd, sorted ? input.buffer : output.buffer, readback.buffer, result_copy_count, result_copies);
+
+         double start = get_seconds();
+         immediate_submit(vk);
+         double elapsed = get_seconds() - start;
+
+         if(timestamps)
+         {
+            u64 ticks[2];
+            VK_CHECK(vkGetQueryPoolResults(vk->device, timestamps, 0, 2, sizeof(ticks), ticks, sizeof(u64),
+                                           VK_QUERY_RESULT_64_BIT|VK_QUERY_RESULT_WAIT_BIT));
+            elapsed = (ticks[1] - ticks[0]) * (double)vk->timestamp_period * 1e-9;
+         }
+         if(elapsed < best_seconds) best_seconds = elapsed;
+      }
+
+      VK_CHECK(vmaInvalidateAllocation(vk->allocator, readback.allocation, 0, VK_WHOLE_SIZE));
+      b32 matches = check_gpu_primitive(kind, count, data, &layout, readback.memory, &arena);
+      if(!matches)
+      {
+         fprintf(stderr, "Error: %s on %u elements does not match the CPU reference.\n", kind_names[kind], count);
+      }
+
+      compute_kernel *kernel = (kind == GPU_PRIMITIVE_SCAN || kind == GPU_PRIMITIVE_COMPACTION) ? &primitives->scan : &primitives->radix_scatter;
+      begin_benchmark_entry(report);
+      fprintf(report->json, "{\"name\": \"%s\", \"elements\": %u, \"variant\": \"%s\", \"iterations\": %u, "
+              "\"matches\": %s, \"timer\": \"%s\", \"best_ms\": %.4f, \"elements_per_second\": %.0f}",
+              kind_names[kind], count, kernel->uses_subgroups ? "subgroup" : "portable", iteration_count,
+              matches ? "true" : "false", timestamps ? "gpu" : "cpu", best_seconds*1000.0, count/best_seconds);
+   }
+
+   destroy_arena(&arena);
+   if(timestamps)
+   {
+      vkDestroyQueryPool(vk->device, timestamps, get_host_allocator());
+   }
+   destroy_compute_buffer(&readback, vk->allocator);
+   destroy_compute_buffer(&output, vk->allocator);
+   destroy_compute_buffer(&input, vk->allocator);
+   destroy_compute_buffer(&upload, vk->allocator);
+}
+
+static void benchmark_descriptor_allocator(benchmark_report *report, vulkan_context *vk, u32 set_count, u32 frame_count)
+{
+   // NOTE: Starts from a pool far smaller than a frame needs, so the first
+   // frame has to grow through several pools. Every later frame must be served
+   // from the pools the reset handed back without creating any more.
+   VkDescriptorSetLayoutBinding binding = {0};
+   binding.binding = 0;
+   binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+   binding.descriptorCount = 1;
+   binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+   VkDescriptorSetLayoutCreateInfo layout_info = {0};
+   layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+   layout_info.bindingCount = 1;
+   layout_info.pBindings = &binding;
+
+   VkDescriptorSetLayout layout;
+   VK_CHECK(vkCreateDescriptorSetLayout(vk->device, &layout_info, get_host_allocator(), &layout));
+
+   descriptor_pool_ratio ratios[] = {
+      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1},
+   };
+   descriptor_allocator allocator;
+   initialize_descriptor_allocator(&allocator, vk->device, 16, ratios, countof(ratios));
+
+   u32 warm_pool_count = 0;
+   b32 matches = 1;
+   double best_seconds = 1e9;
+   double total_seconds = 0;
+   for(u32 frame = 0; frame < frame_count; ++frame)
+   {
+      if(frame > 0)
+      {
+         reset_descriptor_allocator(&allocator, vk->device);
+      }
+
+      double start = get_seconds();
+      for(u32 set_index = 0; set_index < set_count; ++set_index)
+      {
+         VkDescriptorSet set = allocate_descriptor_set(&allocator, vk->device, layout, 0);
+         if(set == VK_NULL_HANDLE)
+         {
+            matches = 0;
+         }
+      }
+      double elapsed = get_seconds() - start;
+
+      if(allocator.stats.allocated_sets != set_count)
+      {
+         matches = 0;
+      }
+      if(frame == 0)
+      {
+         warm_pool_count = allocator.stats.pool_count;
+      }
+      else
+      {
+         total_seconds += elapsed;
+         if(elapsed < best_seconds) best_seconds = elapsed;
+      }
+   }
+   b32 reused = (frame_count > 1 && allocator.stats.pool_count == warm_pool_count);
+
+   begin_benchmark_entry(report);
+   fprintf(report->json, "{\"name\": \"descriptor_allocator\", \"sets\": %u, \"frames\": %u, \"pools\": %u, "
+           "\"pools_after_warmup\": %u, \"matches\": %s, \"reused\": %s, \"best_ms\": %.4f, \"average_ms\": %.4f, "
+           "\"sets_per_second\": %.0f}",
+           set_count, frame_count, warm_pool_count, allocator.stats.pool_count, matches ? "true" : "false",
+           reused ? "true" : "false", best_seconds*1000.0, total_seconds*1000.0/(frame_count - 1), set_count/best_seconds);
+
+   deinitialize_descriptor_allocator(&allocator, vk->device);
+   vkDestroyDescriptorSetLayout(vk->device, layout, get_host_allocator());
+}
+
+static void report_memory_budget(benchmark_report *report, vulkan_context *vk)
+{
+   memory_budget *memory = &vk->memory;
+   update_memory_budget(memory, vk->allocator);
+
+   begin_benchmark_entry(report);
+   fprintf(report->json, "{\"name\": \"memory_budget\", \"budget_extension\": %s, \"pressure\": %.4f, \"heaps\": [",
+           memory->budget_extension ? "true" : "false", memory->pressure);
+   for(u32 heap_index = 0; heap_index < memory->heap_count; ++heap_index)
+   {
+      memory_heap_budget *heap = memory->heaps + heap_index;
+      fprintf(report->json, "%s{\"device_local\": %s, \"size\": %llu, \"usage\": %llu, \"budget\": %llu, \"allocated\": %llu}",
+              (heap_index > 0) ? ", " : "", (heap->flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? "true" : "false",
+              (unsigned long long)heap->size, (unsigned long long)heap->usage,
+              (unsigned long long)heap->budget, (unsigned long long)heap->allocated);
+   }
+   fprintf(report->json, "], \"subsystems\": {");
+   for(u32 subsystem = 0; subsystem < MEMORY_SUBSYSTEM_COUNT; ++subsystem)
+   {
+      fprintf(report->json, "%s\"%s\": {\"allocations\": %u, \"bytes\": %llu}", (subsystem > 0) ? ", " : "",
+              get_memory_subsystem_name(subsystem), memory->subsystem_allocations[subsystem],
+              (unsigned long long)memory->subsystem_bytes[subsystem]);
+   }
+   fprintf(report->json, "}}");
+}
+
+void run_benchmarks(vulkan_context *vk, char *output_path)
+{
+   benchmark_report report = {0};
+   report.json = fopen(output_path, "w");
+   if(!report.json)
+   {
+      fprintf(stderr, "Error: Failed to open benchmark output %s.\n", output_path);
+      return;
+   }
+
+   fprintf(report.json, "{\n  \"benchmarks\": [\n");
+
+   benchmark_culling(&report, 10*1000, 200);
+   benchmark_culling(&report, 1000*1000, 20);
+   benchmark_job_scaling(&report, 1000*1000, 10);
+   benchmark_descriptor_allocator(&report, vk, 10*1000, 10);
+
+   // NOTE: The GPU primitives run with whichever variant the device picks,
+   // then once more forced onto the portable one if that was not it already.
+   b32 subgroups_disabled = vk->subgroups.disabled;
+   b32 used_subgroups = 0;
+   for(u32 variant = 0; variant < 2; ++variant)
+   {
+      if(variant == 1 && !used_subgroups)
+      {
+         break;
+      }
+      vk->subgroups.disabled = subgroups_disabled || (variant == 1);
+
+      gpu_primitives primitives;
+      initialize_gpu_primitives(&primitives, vk, 4*1024*1024);
+      used_subgroups = (primitives.scan.uses_subgroups || primitives.radix_scatter.uses_subgroups);
+
+      benchmark_gpu_primitives(&report, vk, &primitives, 64*1024, 20);
+      benchmark_gpu_primitives(&report, vk, &primitives, 4*1024*1024, 10);
+      deinitialize_gpu_primitives(&primitives, vk);
+   }
+   vk->subgroups.disabled = subgroups_disabled;
+
+   report_memory_budget(&report, vk);
+
+   fprintf(report.json, "\n  ]\n}\n");
+   fclose(report.json);
+
+   printf("Wrote benchmark results to %s.\n", output_path);
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+#include "vk.h"
+
+void run_benchmarks(vulkan_context *vk, char *output_path);
@@ -0,0 +1,302 @@
+#include "bindless.h"
+#include "host_allocator.h"
+#include "memory_budget.h"
+
+static u32 clamp_descriptor_count(u32 count, u32 limit)
+{
+   return((count < limit) ? count : limit);
+}
+
+static VkDeviceSize align_descriptor_offset(VkDeviceSize offset, VkDeviceSize alignment)
+{
+   return((offset + alignment - 1) & ~(alignment - 1));
+}
+
+static void initialize_descriptor_buffer(bindless_descriptors *bindless, VkDevice device, VmaAllocator allocator,
+                                         VkPhysicalDeviceDescriptorBufferPropertiesEXT *properties)
+{
+   PFN_vkGetDescriptorSetLayoutSizeEXT get_layout_size = (PFN_vkGetDescriptorSetLayoutSizeEXT)vkGetDeviceProcAddr(device, "vkGetDescriptorSetLayoutSizeEXT");
+   PFN_vkGetDescriptorSetLayoutBindingOffsetEXT get_binding_offset = (PFN_vkGetDescriptorSetLayoutBindingOffsetEXT)vkGetDeviceProcAddr(device, "vkGetDescriptorSetLayoutBindingOffsetEXT");
+   bindless->get_descriptor = (PFN_vkGetDescriptorEXT)vkGetDeviceProcAddr(device, "vkGetDescriptorEXT");
+
+   VkDeviceSize layout_size;
+   get_layout_size(device, bindless->layout, &layout_size);
+   layout_size = align_descriptor_offset(layout_size, properties->descriptorBufferOffsetAlignment);
+
+   get_binding_offset(device, bindless->layout, BINDLESS_STORAGE_IMAGE_BINDING, bindless->binding_offsets + BINDLESS_STORAGE_IMAGE_BINDING);
+   get_binding_offset(device, bindless->layout, BINDLESS_SAMPLED_IMAGE_BINDING, bindless->binding_offsets + BINDLESS_SAMPLED_IMAGE_BINDING);
+   get_binding_offset(device, bindless->layout, BINDLESS_SAMPLER_BINDING, bindless->binding_offsets + BINDLESS_SAMPLER_BINDING);
+
+   bindless->descriptor_sizes[BINDLESS_STORAGE_IMAGE_BINDING] = properties->storageImageDescriptorSize;
+   bindless->descriptor_sizes[BINDLESS_SAMPLED_IMAGE_BINDING] = properties->sampledImageDescriptorSize;
+   bindless->descriptor_sizes[BINDLESS_SAMPLER_BINDING] = properties->samplerDescriptorSize;
+
+   // NOTE: The set mixes samplers and images, so the buffer needs both usages.
+   bindless->descriptor_buffer_usage =
+      VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT|
+      VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT|
+      VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+
+   VkBufferCreateInfo buffer_info = {0};
+   buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+   buffer_info.size = layout_size;
+   buffer_info.usage = bindless->descriptor_buffer_usage;
+
+   VmaAllocationCreateInfo allocation_info = {0};
+   allocation_info.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+   allocation_info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+   VmaAllocationInfo allocation_result;
+   VK_CHECK(vmaCreateBuffer(allocator, &buffer_info, &allocation_info, &bindless->descriptor_buffer,
+                            &bindless->descriptor_buffer_allocation, &allocation_result));
+   track_memory_allocation(allocator, bindless->descriptor_buffer_allocation, MEMORY_SUBSYSTEM_DESCRIPTORS);
+   bindless->descriptor_buffer_memory = allocation_result.pMappedData;
+   memset(bindless->descriptor_buffer_memory, 0, layout_size);
+
+   VkBufferDeviceAddressInfo address_info = {0};
+   address_info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+   address_info.buffer = bindless->descriptor_buffer;
+   bindless->descriptor_buffer_address = vkGetBufferDeviceAddress(device, &address_info);
+}
+
+void initialize_bindless_descriptors(bindless_descriptors *bindless, VkPhysicalDevice gpu, VkDevice device, VmaAllocator allocator, b32 use_descriptor_buffer)
+{
+   memset(bindless, 0, sizeof(*bindless));
+   bindless->use_descriptor_buffer = use_descriptor_buffer;
+
+   VkPhysicalDeviceDescriptorBufferPropertiesEXT descriptor_buffer_properties = {0};
+   descriptor_buffer_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT;
+
+   VkPhysicalDeviceVulkan12Properties properties12 = {0};
+   properties12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+   properties12.pNext = use_descriptor_buffer ? &descriptor_buffer_properties : 0;
+
+   VkPhysicalDeviceProperties2 properties2 = {0};
+   properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+   properties2.pNext = &properties12;
+   vkGetPhysicalDeviceProperties2(gpu, &properties2);
+
+   if(use_descriptor_buffer)
+   {
+      // NOTE: Descriptor buffers don't use update-after-bind, so the regular
+      // per-stage limits apply.
+      VkPhysicalDeviceLimits *limits = &properties2.properties.limits;
+      bindless->storage_image_capacity = clamp_descriptor_count(BINDLESS_MAX_STORAGE_IMAGES, limits->maxPerStageDescriptorStorageImages);
+      bindless->sampled_image_capacity = clamp_descriptor_count(BINDLESS_MAX_SAMPLED_IMAGES, limits->maxPerStageDescriptorSampledImages);
+      bindless->sampler_capacity = clamp_descriptor_count(BINDLESS_MAX_SAMPLERS, limits->maxPerStageDescriptorSamplers);
+   }
+   else
+   {
+      // NOTE: Update-after-bind descriptors have their own, usually much larger,
+      // per-stage limits. Clamp the array sizes to them.
+      bindless->storage_image_capacity = clamp_descriptor_count(BINDLESS_MAX_STORAGE_IMAGES, properties12.maxPerStageDescriptorUpdateAfterBindStorageImages);
+      bindless->sampled_image_capacity = clamp_descriptor_count(BINDLESS_MAX_SAMPLED_IMAGES, properties12.maxPerStageDescriptorUpdateAfterBindSampledImages);
+      bindless->sampler_capacity = clamp_descriptor_count(BINDLESS_MAX_SAMPLERS, properties12.maxPerStageDescriptorUpdateAfterBindSamplers);
+   }
+
+   VkShaderStageFlags stages = BINDLESS_PUSH_CONSTANT_STAGES;
+
+   VkDescriptorSetLayoutBinding bindings[3] = {0};
+   bindings[0].binding = BINDLESS_STORAGE_IMAGE_BINDING;
+   bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+   bindings[0].descriptorCount = bindless->storage_image_capacity;
+   bindings[0].stageFlags = stages;
+
+   bindings[1].binding = BINDLESS_SAMPLED_IMAGE_BINDING;
+   bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+   bindings[1].descriptorCount = bindless->sampled_image_capacity;
+   bindings[1].stageFlags = stages;
+
+   bindings[2].binding = BINDLESS_SAMPLER_BINDING;
+   bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+   bindings[2].descriptorCount = bindless->sampler_capacity;
+   bindings[2].stageFlags = stages;
+
+   // NOTE: Partially bound lets the arrays contain unwritten slots, and update
+   // after bind lets new entries be written while the set is in use by frames
+   // in flight, as long as those frames don't access them. Descriptor buffers
+   // get the latter for free, since writes are plain memory writes.
+   VkDescriptorBindingFlags binding_flags[3];
+   for(int index = 0; index < countof(binding_flags); ++index)
+   {
+      binding_flags[index] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+      if(!use_descriptor_buffer)
+      {
+         binding_flags[index] |= VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT;
+      }
+   }
+
+   VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_info = {0};
+   binding_flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+   binding_flags_info.bindingCount = countof(binding_flags);
+   binding_flags_info.pBindingFlags = binding_flags;
+
+   VkDescriptorSetLayoutCreateInfo layout_info = {0};
+   layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+   layout_info.pNext = &binding_flags_info;
+   layout_info.flags = use_descriptor_buffer
+      ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT
+      : VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+   layout_info.bindingCount = countof(bindings);
+   layout_info.pBindings = bindings;
+
+   VK_CHECK(vkCreateDescriptorSetLayout(device, &layout_info, get_host_allocator(), &bindless->layout));
+
+   if(use_descriptor_buffer)
+   {
+      initialize_descriptor_buffer(bindless, device, allocator, &descriptor_buffer_properties);
+      bindless->pipeline_flags = VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT;
+   }
+   else
+   {
+      VkDescriptorPoolSize pool_sizes[3] = {0};
+      pool_sizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+      pool_sizes[0].descriptorCount = bindless->storage_image_capacity;
+      pool_sizes[1].type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+      pool_sizes[1].descriptorCount = bindless->sampled_image_capacity;
+      pool_sizes[2].type = VK_DESCRIPTOR_TYPE_SAMPLER;
+      pool_sizes[2].descriptorCount = bindless->sampler_capacity;
+
+      VkDescriptorPoolCreateInfo pool_info = {0};
+      pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+      pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+      pool_info.maxSets = 1;
+      pool_info.poolSizeCount = countof(pool_sizes);
+      pool_info.pPoolSizes = pool_sizes;
+
+      VK_CHECK(vkCreateDescriptorPool(device, &pool_info, get_host_allocator(), &bindless->pool));
+
+      VkDescriptorSetAllocateInfo allocation_info = {0};
+      allocation_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+      allocation_info.descriptorPool = bindless->pool;
+      allocation_info.descriptorSetCount = 1;
+      allocation_info.pSetLayouts = &bindless->layout;
+
+      VK_CHECK(vkAllocateDescriptorSets(device, &allocation_info, &bindless->set));
+   }
+
+   VkPushConstantRange push_constant_range = {0};
+   push_constant_range.offset = 0;
+   push_constant_range.size = BINDLESS_PUSH_CONSTANT_SIZE;
+   push_constant_range.stageFlags = BINDLESS_PUSH_CONSTANT_STAGES;
+
+   VkPipelineLayoutCreateInfo pipeline_layout_info = {0};
+   pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+   pipeline_layout_info.setLayoutCount = 1;
+   pipeline_layout_info.pSetLayouts = &bindless->layout;
+   pipeline_layout_info.pushConstantRangeCount = 1;
+   pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+   VK_CHECK(vkCreatePipelineLayout(device, &pipeline_layout_info, get_host_allocator(), &bindless->pipeline_layout));
+}
+
+void deinitialize_bindless_descriptors(bindless_descriptors *bindless, VkDevice device, VmaAllocator allocator)
+{
+   vkDestroyPipelineLayout(device, bindless->pipeline_layout, get_host_allocator());
+   if(bindless->use_descriptor_buffer)
+   {
+      untrack_memory_allocation(allocator, bindless->descriptor_buffer_allocation, MEMORY_SUBSYSTEM_DESCRIPTORS);
+      vmaDestroyBuffer(allocator, bindless->descriptor_buffer, bindless->descriptor_buffer_allocation);
+   }
+   else
+   {
+      vkDestroyDescriptorPool(device, bindless->pool, get_host_allocator());
+   }
+   vkDestroyDescriptorSetLayout(device, bindless->layout, get_host_allocator());
+}
+
+static void write_bindless_descriptor(bindless_descriptors *bindless, VkDevice device, u32 binding, VkDescriptorType type, u32 index, VkDescriptorImageInfo *image_info)
+{
+   if(bindless->use_descriptor_buffer)
+   {
+      VkDescriptorGetInfoEXT get_info = {0};
+      get_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT;
+      get_info.type = type;
+      if(type == VK_DESCRIPTOR_TYPE_SAMPLER)
+      {
+         get_info.data.pSampler = &image_info->sampler;
+      }
+      else if(type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE)
+      {
+         get_info.data.pSampledImage = image_info;
+      }
+      else
+      {
+         get_info.data.pStorageImage = image_info;
+      }
+
+      size_t size = bindless->descriptor_sizes[binding];
+      u8 *destination = bindless->descriptor_buffer_memory + bindless->binding_offsets[binding] + index*size;
+      bindless->get_descriptor(device, &get_info, size, destination);
+   }
+   else
+   {
+      VkWriteDescriptorSet write = {0};
+      write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      write.dstSet = bindless->set;
+      write.dstBinding = binding;
+      write.dstArrayElement = index;
+      write.descriptorCount = 1;
+      write.descriptorType = type;
+      write.pImageInfo = image_info;
+
+      vkUpdateDescriptorSets(device, 1, &write, 0, 0);
+   }
+}
+
+u32 add_bindless_storage_image(bindless_descriptors *bindless, VkDevice device, VkImageView view)
+{
+   assert(bindless->storage_image_count < bindless->storage_image_capacity);
+   u32 result = bindless->storage_image_count++;
+
+   VkDescriptorImageInfo image_info = {0};
+   image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+   image_info.imageView = view;
+   write_bindless_descriptor(bindless, device, BINDLESS_STORAGE_IMAGE_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, result, &image_info);
+
+   return(result);
+}
+
+u32 add_bindless_sampled_image(bindless_descriptors *bindless, VkDevice device, VkImageView view)
+{
+   assert(bindless->sampled_image_count < bindless->sampled_image_capacity);
+   u32 result = bindless->sampled_image_count++;
+
+   VkDescriptorImageInfo image_info = {0};
+   image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+   image_info.imageView = view;
+   write_bindless_descriptor(bindless, device, BINDLESS_SAMPLED_IMAGE_BINDING, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, result, &image_info);
+
+   return(result);
+}
+
+u32 add_bindless_sampler(bindless_descriptors *bindless, VkDevice device, VkSampler sampler)
+{
+   assert(bindless->sampler_count < bindless->sampler_capacity);
+   u32 result = bindless->sampler_count++;
+
+   VkDescriptorImageInfo image_info = {0};
+   image_info.sampler = sampler;
+   write_bindless_descriptor(bindless, device, BINDLESS_SAMPLER_BINDING, VK_DESCRIPTOR_TYPE_SAMPLER, result, &image_info);
+
+   return(result);
+}
+
+void bind_bindless_descriptors(command_recorder *recorder, bindless_descriptors *bindless, VkPipelineBindPoint bind_point)
+{
+   if(bindless->use_descriptor_buffer)
+   {
+      record_bind_descriptor_buffer(recorder, bindless->descriptor_buffer_address, bindless->descriptor_buffer_usage);
+      record_set_descriptor_buffer_offset(recorder, bind_point, bindless->pipeline_layout, 0, 0);
+   }
+   else
+   {
+      record_bind_descriptor_set(recorder, bind_point, bindless->pipeline_layout, 0, bindless->set);
+   }
+}
+
+void push_bindless_constants(command_recorder *recorder, bindless_descriptors *bindless, u32 size, void *data)
+{
+   assert(size <= BINDLESS_PUSH_CONSTANT_SIZE);
+   record_push_constants(recorder, bindless->pipeline_layout, BINDLESS_PUSH_CONSTANT_STAGES, 0, size, data);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "vk.h"
+#include "command_recorder.h"
+
+// NOTE: Every pipeline shares one pipeline layout: the global bindless set at
+// set 0 and a single push constant range visible to all stages. Shaders pick
+// their resources out of the global arrays with indices passed in push
+// constants, so adding images or materials never adds set binds or layouts.
+#define BINDLESS_STORAGE_IMAGE_BINDING 0
+#define BINDLESS_SAMPLED_IMAGE_BINDING 1
+#define BINDLESS_SAMPLER_BINDING 2
+
+#define BINDLESS_MAX_STORAGE_IMAGES 1024
+#define BINDLESS_MAX_SAMPLED_IMAGES 4096
+#define BINDLESS_MAX_SAMPLERS 64
+
+#define BINDLESS_PUSH_CONSTANT_SIZE 128
+#define BINDLESS_PUSH_CONSTANT_STAGES (VK_SHADER_STAGE_ALL_GRAPHICS|VK_SHADER_STAGE_COMPUTE_BIT)
+
+void initialize_bindless_descriptors(bindless_descriptors *bindless, VkPhysicalDevice gpu, VkDevice device, VmaAllocator allocator, b32 use_descriptor_buffer);
+void deinitialize_bindless_descriptors(bindless_descriptors *bindless, VkDevice device, VmaAllocator allocator);
+
+u32 add_bindless_storage_image(bindless_descriptors *bindless, VkDevice device, VkImageView view);
+u32 add_bindless_sampled_image(bindless_descriptors *bindless, VkDevice device, VkImageView view);
+u32 add_bindless_sampler(bindless_descriptors *bindless, VkDevice device, VkSampler sampler);
+
+void bind_bindless_descriptors(command_recorder *recorder, bindless_descriptors *bindless, VkPipelineBindPoint bind_point);
+void push_bindless_constants(command_recorder *recorder, bindless_descriptors *bindless, u32 size, void *data);
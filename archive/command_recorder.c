@@ -0,0 +1,220 @@
+#include "command_recorder.h"
+
+static PFN_vkCmdBindDescriptorBuffersEXT cmd_bind_descriptor_buffers;
+static PFN_vkCmdSetDescriptorBufferOffsetsEXT cmd_set_descriptor_buffer_offsets;
+
+static int get_bind_point_index(VkPipelineBindPoint bind_point)
+{
+   assert(bind_point == VK_PIPELINE_BIND_POINT_GRAPHICS || bind_point == VK_PIPELINE_BIND_POINT_COMPUTE);
+   return(bind_point == VK_PIPELINE_BIND_POINT_COMPUTE);
+}
+
+void load_recorder_functions(VkDevice device)
+{
+   cmd_bind_descriptor_buffers = (PFN_vkCmdBindDescriptorBuffersEXT)vkGetDeviceProcAddr(device, "vkCmdBindDescriptorBuffersEXT");
+   cmd_set_descriptor_buffer_offsets = (PFN_vkCmdSetDescriptorBufferOffsetsEXT)vkGetDeviceProcAddr(device, "vkCmdSetDescriptorBufferOffsetsEXT");
+}
+
+void begin_recorder(command_recorder *recorder, VkCommandBuffer cmd)
+{
+   memset(recorder, 0, sizeof(*recorder));
+   recorder->cmd = cmd;
+}
+
+void invalidate_recorder_state(command_recorder *recorder)
+{
+   VkCommandBuffer cmd = recorder->cmd;
+   command_recorder_stats stats = recorder->stats;
+
+   begin_recorder(recorder, cmd);
+   recorder->stats = stats;
+}
+
+void add_recorder_stats(command_recorder_stats *dest, command_recorder_stats *source)
+{
+   dest->recorded_calls += source->recorded_calls;
+   dest->elided_pipeline_binds += source->elided_pipeline_binds;
+   dest->elided_descriptor_binds += source->elided_descriptor_binds;
+   dest->elided_index_buffer_binds += source->elided_index_buffer_binds;
+   dest->elided_viewports += source->elided_viewports;
+   dest->elided_scissors += source->elided_scissors;
+   dest->elided_push_constants += source->elided_push_constants;
+   dest->push_constant_bytes_saved += source->push_constant_bytes_saved;
+}
+
+void record_bind_pipeline(command_recorder *recorder, VkPipelineBindPoint bind_point, VkPipeline pipeline)
+{
+   int index = get_bind_point_index(bind_point);
+   if(recorder->pipelines[index] == pipeline)
+   {
+      recorder->stats.elided_pipeline_binds++;
+      return;
+   }
+
+   vkCmdBindPipeline(recorder->cmd, bind_point, pipeline);
+   recorder->pipelines[index] = pipeline;
+   recorder->stats.recorded_calls++;
+}
+
+void record_bind_descriptor_set(command_recorder *recorder, VkPipelineBindPoint bind_point, VkPipelineLayout layout, u32 set_index, VkDescriptorSet set)
+{
+   assert(set_index < RECORDER_MAX_DESCRIPTOR_SETS);
+
+   int index = get_bind_point_index(bind_point);
+   if(recorder->descriptor_layouts[index] == layout && recorder->descriptor_sets[index][set_index] == set)
+   {
+      recorder->stats.elided_descriptor_binds++;
+      return;
+   }
+
+   vkCmdBindDescriptorSets(recorder->cmd, bind_point, layout, set_index, 1, &set, 0, 0);
+
+   // NOTE: Binding with a different layout may disturb sets bound with the
+   // old one, so forget about them rather than reasoning about compatibility.
+   if(recorder->descriptor_layouts[index] != layout)
+   {
+      memset(recorder->descriptor_sets[index], 0, sizeof(recorder->descriptor_sets[index]));
+      recorder->descriptor_layouts[index] = layout;
+   }
+   recorder->descriptor_sets[index][set_index] = set;
+   memset(recorder->descriptor_offsets_valid[index], 0, sizeof(recorder->descriptor_offsets_valid[index]));
+   recorder->stats.recorded_calls++;
+}
+
+void record_bind_descriptor_buffer(command_recorder *recorder, VkDeviceAddress address, VkBufferUsageFlags usage)
+{
+   assert(cmd_bind_descriptor_buffers);
+   if(recorder->descriptor_buffer == address)
+   {
+      recorder->stats.elided_descriptor_binds++;
+      return;
+   }
+
+   VkDescriptorBufferBindingInfoEXT binding_info = {0};
+   binding_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_INFO_EXT;
+   binding_info.address = address;
+   binding_info.usage = usage;
+   cmd_bind_descriptor_buffers(recorder->cmd, 1, &binding_info);
+
+   // NOTE: Rebinding the buffers invalidates the offsets at both bind points.
+   recorder->descriptor_buffer = address;
+   memset(recorder->descriptor_offsets_valid, 0, sizeof(recorder->descriptor_offsets_valid));
+   recorder->stats.recorded_calls++;
+}
+
+void record_set_descriptor_buffer_offset(command_recorder *recorder, VkPipelineBindPoint bind_point, VkPipelineLayout layout, u32 set_index, VkDeviceSize offset)
+{
+   assert(set_index < RECORDER_MAX_DESCRIPTOR_SETS);
+   assert(cmd_set_descriptor_buffer_offsets);
+
+   int index = get_bind_point_index(bind_point);
+   if(recorder->descriptor_layouts[index] == layout &&
+      recorder->descriptor_offsets_valid[index][set_index] &&
+      recorder->descriptor_offsets[index][set_index] == offset)
+   {
+      recorder->stats.elided_descriptor_binds++;
+      return;
+   }
+
+   u32 buffer_index = 0;
+   cmd_set_descriptor_buffer_offsets(recorder->cmd, bind_point, layout, set_index, 1, &buffer_index, &offset);
+
+   if(recorder->descriptor_layouts[index] != layout)
+   {
+      memset(recorder->descriptor_offsets_valid[index], 0, sizeof(recorder->descriptor_offsets_valid[index]));
+      recorder->descriptor_layouts[index] = layout;
+   }
+   memset(recorder->descriptor_sets[index], 0, sizeof(recorder->descriptor_sets[index]));
+   recorder->descriptor_offsets_valid[index][set_index] = 1;
+   recorder->descriptor_offsets[index][set_index] = offset;
+   recorder->stats.recorded_calls++;
+}
+
+void record_bind_index_buffer(command_recorder *recorder, VkBuffer buffer, VkDeviceSize offset, VkIndexType index_type)
+{
+   if(recorder->index_buffer == buffer && recorder->index_offset == offset && recorder->index_type == index_type)
+   {
+      recorder->stats.elided_index_buffer_binds++;
+      return;
+   }
+
+   vkCmdBindIndexBuffer(recorder->cmd, buffer, offset, index_type);
+   recorder->index_buffer = buffer;
+   recorder->index_offset = offset;
+   recorder->index_type = index_type;
+   recorder->stats.recorded_calls++;
+}
+
+void record_set_viewport(command_recorder *recorder, VkViewport *viewport)
+{
+   if(recorder->viewport_valid && memcmp(&recorder->viewport, viewport, sizeof(*viewport)) == 0)
+   {
+      recorder->stats.elided_viewports++;
+      return;
+   }
+
+   vkCmdSetViewport(recorder->cmd, 0, 1, viewport);
+   recorder->viewport = *viewport;
+   recorder->viewport_valid = 1;
+   recorder->stats.recorded_calls++;
+}
+
+void record_set_scissor(command_recorder *recorder, VkRect2D *scissor)
+{
+   if(recorder->scissor_valid && memcmp(&recorder->scissor, scissor, sizeof(*scissor)) == 0)
+   {
+      recorder->stats.elided_scissors++;
+      return;
+   }
+
+   vkCmdSetScissor(recorder->cmd, 0, 1, scissor);
+   recorder->scissor = *scissor;
+   recorder->scissor_valid = 1;
+   recorder->stats.recorded_calls++;
+}
+
+void record_push_constants(command_recorder *recorder, VkPipelineLayout layout, VkShaderStageFlags stages, u32 offset, u32 size, void *data)
+{
+   assert(offset + size <= RECORDER_MAX_PUSH_CONSTANT_SIZE);
+   assert((offset % 4) == 0 && (size % 4) == 0);
+
+   if(recorder->push_layout != layout || recorder->push_stages != stages)
+   {
+      recorder->push_layout = layout;
+      recorder->push_stages = stages;
+      recorder->push_valid_size = 0;
+   }
+
+   // NOTE: Only the bytes that differ from what was last pushed are recorded,
+   // trimmed to whole words. Bytes past the known-valid prefix always count as
+   // different.
+   u8 *bytes = data;
+   u32 first = size;
+   u32 last = 0;
+   for(u32 index = 0; index < size; index += 4)
+   {
+      u32 cached_offset = offset + index;
+      b32 known = (cached_offset + 4 <= recorder->push_valid_size);
+      if(!known || memcmp(recorder->push_constants + cached_offset, bytes + index, 4) != 0)
+      {
+         if(first == size) first = index;
+         last = index + 4;
+      }
+   }
+
+   if(first == size)
+   {
+      recorder->stats.elided_push_constants++;
+      return;
+   }
+
+   vkCmdPushConstants(recorder->cmd, layout, stages, offset + first, last - first, bytes + first);
+   memcpy(recorder->push_constants + offset + first, bytes + first, last - first);
+   recorder->stats.recorded_calls++;
+   recorder->stats.push_constant_bytes_saved += size - (last - first);
+
+   if(offset <= recorder->push_valid_size && offset + last > recorder->push_valid_size)
+   {
+      recorder->push_valid_size = offset + last;
+   }
+}
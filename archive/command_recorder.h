@@ -0,0 +1,55 @@
+#pragma once
+
+#include "vk.h"
+
+#define RECORDER_MAX_DESCRIPTOR_SETS 4
+#define RECORDER_MAX_PUSH_CONSTANT_SIZE 128
+
+// NOTE: A thin layer over a command buffer that remembers the state it last
+// recorded and drops calls that would not change it. Anything that records
+// into the same command buffer behind its back (e.g. ImGui) must be followed
+// by invalidate_recorder_state.
+typedef struct {
+   VkCommandBuffer cmd;
+   command_recorder_stats stats;
+
+   VkPipeline pipelines[2];
+   VkPipelineLayout descriptor_layouts[2];
+   VkDescriptorSet descriptor_sets[2][RECORDER_MAX_DESCRIPTOR_SETS];
+
+   VkDeviceAddress descriptor_buffer;
+   b32 descriptor_offsets_valid[2][RECORDER_MAX_DESCRIPTOR_SETS];
+   VkDeviceSize descriptor_offsets[2][RECORDER_MAX_DESCRIPTOR_SETS];
+
+   VkBuffer index_buffer;
+   VkDeviceSize index_offset;
+   VkIndexType index_type;
+
+   b32 viewport_valid;
+   VkViewport viewport;
+
+   b32 scissor_valid;
+   VkRect2D scissor;
+
+   VkPipelineLayout push_layout;
+   VkShaderStageFlags push_stages;
+   u32 push_valid_size;
+   u8 push_constants[RECORDER_MAX_PUSH_CONSTANT_SIZE];
+} command_recorder;
+
+// NOTE: Loads the extension commands the recorder may issue. Only needed when
+// the device was created with VK_EXT_descriptor_buffer.
+void load_recorder_functions(VkDevice device);
+
+void begin_recorder(command_recorder *recorder, VkCommandBuffer cmd);
+void invalidate_recorder_state(command_recorder *recorder);
+void add_recorder_stats(command_recorder_stats *dest, command_recorder_stats *source);
+
+void record_bind_pipeline(command_recorder *recorder, VkPipelineBindPoint bind_point, VkPipeline pipeline);
+void record_bind_descriptor_set(command_recorder *recorder, VkPipelineBindPoint bind_point, VkPipelineLayout layout, u32 set_index, VkDescriptorSet set);
+void record_bind_descriptor_buffer(command_recorder *recorder, VkDeviceAddress address, VkBufferUsageFlags usage);
+void record_set_descriptor_buffer_offset(command_recorder *recorder, VkPipelineBindPoint bind_point, VkPipelineLayout layout, u32 set_index, VkDeviceSize offset);
+void record_bind_index_buffer(command_recorder *recorder, VkBuffer buffer, VkDeviceSize offset, VkIndexType index_type);
+void record_set_viewport(command_recorder *recorder, VkViewport *viewport);
+void record_set_scissor(command_recorder *recorder, VkRect2D *scissor);
+void record_push_constants(command_recorder *recorder, VkPipelineLayout layout, VkShaderStageFlags stages, u32 offset, u32 size, void *data);
@@ -0,0 +1,344 @@
+#include "compute_effects.h"
+#include "host_allocator.h"
+#include "shaders.h"
+#include "workgroup_tuner.h"
+
+void initialize_compute_effects(compute_effect_registry *registry, VkPipelineLayout layout, VkPipelineCreateFlags pipeline_flags, char *shader_suffix)
+{
+   memset(registry, 0, sizeof(*registry));
+
+   registry->layout = layout;
+   registry->pipeline_flags = pipeline_flags;
+   registry->shader_suffix = shader_suffix;
+   registry->fuse_chain = 1;
+
+   registry->fused.name = "fused chain";
+   registry->fused.shader_name = "background_chain";
+
+   registry->upsample.name = "upsample";
+   registry->upsample.shader_name = "background_upsample";
+   registry->upsample.workgroup = (workgroup_size){DEFAULT_WORKGROUP_SIZE_X, DEFAULT_WORKGROUP_SIZE_Y};
+}
+
+void deinitialize_compute_effects(compute_effect_registry *registry, VkDevice device)
+{
+   for(u32 pipeline_index = 0; pipeline_index < registry->pipeline_count; ++pipeline_index)
+   {
+      compute_effect_pipeline *cached = registry->pipelines + pipeline_index;
+      if(cached->pipeline)
+      {
+         vkDestroyPipeline(device, cached->pipeline, get_host_allocator());
+      }
+      if(cached->owns_module)
+      {
+         vkDestroyShaderModule(device, cached->module, get_host_allocator());
+      }
+   }
+
+   memset(registry, 0, sizeof(*registry));
+}
+
+compute_effect *register_compute_effect(compute_effect_registry *registry, char *name, char *shader_name, background_effect_kind kind, u32 flags,
+                                        effect_parameter *parameters, u32 parameter_count)
+{
+   assert(registry->effect_count < MAX_COMPUTE_EFFECTS);
+   assert(parameter_count <= MAX_EFFECT_PARAMETERS);
+   assert(!find_compute_effect(registry, name));
+
+   compute_effect *result = registry->effects + registry->effect_count++;
+   memset(result, 0, sizeof(*result));
+
+   result->name = name;
+   result->shader_name = shader_name;
+   result->kind = kind;
+   result->flags = flags;
+   result->resolution_divisor = 1;
+   for(u32 parameter_index = 0; parameter_index < parameter_count; ++parameter_index)
+   {
+      result->parameters[parameter_index] = parameters[parameter_index];
+      result->constants.data[parameter_index] = parameters[parameter_index].initial;
+   }
+
+   return(result);
+}
+
+compute_effect *find_compute_effect(compute_effect_registry *registry, char *name)
+{
+   compute_effect *result = 0;
+   for(u32 effect_index = 0; effect_index < registry->effect_count; ++effect_index)
+   {
+      if(strcmp(registry->effects[effect_index].name, name) == 0)
+      {
+         result = registry->effects + effect_index;
+         break;
+      }
+   }
+
+   return(result);
+}
+
+b32 select_compute_effect(compute_effect_registry *registry, char *name)
+{
+   // NOTE: Overlays only modify what is already there, so they are enabled
+   // on top of the active effect rather than selected.
+   compute_effect *effect = find_compute_effect(registry, name);
+   b32 result = (effect && !(effect->flags & COMPUTE_EFFECT_OVERLAY));
+   if(result)
+   {
+      registry->active_effect = (u32)(effect - registry->effects);
+   }
+
+   return(result);
+}
+
+compute_effect *get_active_compute_effect(compute_effect_registry *registry)
+{
+   assert(registry->active_effect < registry->effect_count);
+
+   compute_effect *result = registry->effects + registry->active_effect;
+   return(result);
+}
+
+compute_effect *get_timed_compute_effect(compute_effect_registry *registry, u32 index)
+{
+   compute_effect *result = registry->effects + index;
+   if(index == FUSED_EFFECT_CHAIN)
+   {
+      result = &registry->fused;
+   }
+   else if(index == UPSAMPLED_BACKGROUND)
+   {
+      result = &registry->upsample;
+   }
+
+   return(result);
+}
+
+u32 get_effect_chain_divisor(compute_effect_registry *registry)
+{
+   u32 result = registry->effects[registry->chain[0]].resolution_divisor;
+   if(result < 1) result = 1;
+   if(result > MAX_RESOLUTION_DIVISOR) result = MAX_RESOLUTION_DIVISOR;
+
+   return(result);
+}
+
+VkExtent2D get_compute_effect_extent(VkExtent2D extent, u32 divisor)
+{
+   VkExtent2D result;
+   result.width = (extent.width + divisor - 1) / divisor;
+   result.height = (extent.height + divisor - 1) / divisor;
+
+   return(result);
+}
+
+void build_effect_chain(compute_effect_registry *registry)
+{
+   registry->chain_length = 0;
+   registry->chain[registry->chain_length++] = registry->active_effect;
+
+   for(u32 effect_index = 0; effect_index < registry->effect_count; ++effect_index)
+   {
+      compute_effect *effect = registry->effects + effect_index;
+      if(registry->chain_length < MAX_EFFECT_CHAIN &&
+         effect_index != registry->active_effect &&
+         (effect->flags & COMPUTE_EFFECT_OVERLAY) && effect->enabled)
+      {
+         registry->chain[registry->chain_length++] = effect_index;
+      }
+   }
+}
+
+b32 can_fuse_effect_chain(compute_effect_registry *registry)
+{
+   // NOTE: The fused shader starts from black rather than reading the image
+   // back, so the first stage has to cover the extent.
+   compute_effect *first = registry->effects + registry->chain[0];
+   b32 result = (registry->fuse_chain && registry->chain_length > 1 && (first->flags & COMPUTE_EFFECT_COVERS_EXTENT));
+   for(u32 chain_index = 0; result && chain_index < registry->chain_length; ++chain_index)
+   {
+      if(registry->effects[registry->chain[chain_index]].kind == BACKGROUND_EFFECT_NONE)
+      {
+         result = 0;
+      }
+   }
+
+   return(result);
+}
+
+VkShaderModule get_compute_effect_module(compute_effect_registry *registry, VkDevice device, memory_arena *arena, char *shader_name)
+{
+   // NOTE: Any cached pipeline built from the same shader already holds its
+   // module, whatever its workgroup size.
+   for(u32 pipeline_index = 0; pipeline_index < registry->pipeline_count; ++pipeline_index)
+   {
+      compute_effect_pipeline *cached = registry->pipelines + pipeline_index;
+      if(strcmp(cached->shader_name, shader_name) == 0)
+      {
+         return(cached->module);
+      }
+   }
+
+   assert(registry->pipeline_count < MAX_COMPUTE_EFFECT_PIPELINES);
+   compute_effect_pipeline *cached = registry->pipelines + registry->pipeline_count++;
+   memset(cached, 0, sizeof(*cached));
+
+   char path[128];
+   snprintf(path, sizeof(path), "%s%s.comp.spv", shader_name, registry->shader_suffix);
+   load_shader_module(&cached->module, device, arena, path);
+
+   // NOTE: The entry owns the module but has no pipeline until some workgroup
+   // size is asked for.
+   cached->shader_name = shader_name;
+   cached->owns_module = 1;
+
+   return(cached->module);
+}
+
+VkPipeline create_compute_effect_pipeline(compute_effect_registry *registry, VkDevice device, VkShaderModule module, effect_specialization *specialization)
+{
+   // NOTE: Constants 0 and 1 are the shader's local_size_x_id/local_size_y_id.
+   // Single effects stop there, chains continue with their stages.
+   VkSpecializationMapEntry specialization_entries[3 + MAX_EFFECT_CHAIN] = {
+      {0, offsetof(effect_specialization, workgroup.x), sizeof(u32)},
+      {1, offsetof(effect_specialization, workgroup.y), sizeof(u32)},
+      {2, offsetof(effect_specialization, stage_count), sizeof(u32)},
+   };
+   for(u32 stage = 0; stage < MAX_EFFECT_CHAIN; ++stage)
+   {
+      specialization_entries[3 + stage].constantID = 3 + stage;
+      specialization_entries[3 + stage].offset = offsetof(effect_specialization, stage_kinds) + stage*sizeof(u32);
+      specialization_entries[3 + stage].size = sizeof(u32);
+   }
+
+   VkSpecializationInfo specialization_info = {0};
+   specialization_info.mapEntryCount = (specialization->stage_count > 0) ? countof(specialization_entries) : 2;
+   specialization_info.pMapEntries = specialization_entries;
+   specialization_info.dataSize = sizeof(*specialization);
+   specialization_info.pData = specialization;
+
+   VkPipelineShaderStageCreateInfo stage_create_info = {0};
+   stage_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+   stage_create_info.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+   stage_create_info.module = module;
+   stage_create_info.pName = "main";
+   stage_create_info.pSpecializationInfo = &specialization_info;
+
+   VkComputePipelineCreateInfo compute_pipeline_create_info = {0};
+   compute_pipeline_create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+   compute_pipeline_create_info.layout = registry->layout;
+   compute_pipeline_create_info.flags = registry->pipeline_flags;
+   compute_pipeline_create_info.stage = stage_create_info;
+
+   VkPipeline result;
+   VK_CHECK(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &compute_pipeline_create_info, get_host_allocator(), &result));
+
+   return(result);
+}
+
+static b32 specializations_match(effect_specialization *a, effect_specialization *b)
+{
+   b32 result = (a->workgroup.x == b->workgroup.x &&
+                 a->workgroup.y == b->workgroup.y &&
+                 a->stage_count == b->stage_count);
+   for(u32 stage = 0; result && stage < a->stage_count; ++stage)
+   {
+      result = (a->stage_kinds[stage] == b->stage_kinds[stage]);
+   }
+
+   return(result);
+}
+
+static VkPipeline get_cached_pipeline(compute_effect_registry *registry, VkDevice device, memory_arena *arena, char *shader_name, effect_specialization *specialization)
+{
+   VkShaderModule module = get_compute_effect_module(registry, device, arena, shader_name);
+
+   compute_effect_pipeline *match = 0;
+   compute_effect_pipeline *unused = 0;
+   for(u32 pipeline_index = 0; pipeline_index < registry->pipeline_count; ++pipeline_index)
+   {
+      compute_effect_pipeline *cached = registry->pipelines + pipeline_index;
+      if(strcmp(cached->shader_name, shader_name) == 0)
+      {
+         if(!cached->pipeline)
+         {
+            unused = cached;
+         }
+         else if(specializations_match(&cached->specialization, specialization))
+         {
+            match = cached;
+            break;
+         }
+      }
+   }
+
+   if(!match)
+   {
+      if(unused)
+      {
+         match = unused;
+      }
+      else
+      {
+         assert(registry->pipeline_count < MAX_COMPUTE_EFFECT_PIPELINES);
+         match = registry->pipelines + registry->pipeline_count++;
+         memset(match, 0, sizeof(*match));
+         match->shader_name = shader_name;
+         match->module = module;
+      }
+
+      match->specialization = *specialization;
+      match->pipeline = create_compute_effect_pipeline(registry, device, module, specialization);
+   }
+
+   return(match->pipeline);
+}
+
+void prepare_compute_effect(compute_effect_registry *registry, VkDevice device, memory_arena *arena, compute_effect *effect)
+{
+   if(!effect->pipeline)
+   {
+      effect_specialization specialization = {0};
+      specialization.workgroup = effect->workgroup;
+      effect->pipeline = get_cached_pipeline(registry, device, arena, effect->shader_name, &specialization);
+   }
+}
+
+void prepare_effect_chain(compute_effect_registry *registry, VkDevice device, memory_arena *arena)
+{
+   // NOTE: The chain runs at the workgroup size tuned for its first effect.
+   compute_effect *first = registry->effects + registry->chain[0];
+
+   effect_specialization specialization = {0};
+   specialization.workgroup = first->workgroup;
+   specialization.stage_count = registry->chain_length;
+   for(u32 stage = 0; stage < registry->chain_length; ++stage)
+   {
+      specialization.stage_kinds[stage] = registry->effects[registry->chain[stage]].kind;
+   }
+
+   registry->fused.workgroup = first->workgroup;
+   registry->fused.pipeline = get_cached_pipeline(registry, device, arena, registry->fused.shader_name, &specialization);
+}
+
+void dispatch_compute_effect(command_recorder *recorder, compute_effect *effect, VkExtent2D extent)
+{
+   u32 group_count_x = (extent.width + effect->workgroup.x - 1) / effect->workgroup.x;
+   u32 group_count_y = (extent.height + effect->workgroup.y - 1) / effect->workgroup.y;
+   vkCmdDispatch(recorder->cmd, group_count_x, group_count_y, 1);
+}
+
+void update_compute_effect_timing(compute_effect *effect, float gpu_ms, u64 frame_index)
+{
+   // NOTE: Smoothed so the numbers can be read, but reset if the effect has
+   // not run for a while so a stale average doesn't linger.
+   if(effect->timed_frame == 0 || frame_index > effect->timed_frame + 8)
+   {
+      effect->gpu_ms = gpu_ms;
+   }
+   else
+   {
+      effect->gpu_ms += 0.1f*(gpu_ms - effect->gpu_ms);
+   }
+   effect->timed_frame = frame_index;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "vk.h"
+#include "command_recorder.h"
+
+// NOTE: Background compute effects are registered by name with a description
+// of their push constants, and any one of them can be made active at runtime.
+// Pipelines are created the first time an effect is used and cached by
+// shader and workgroup size, so effects that only differ in their parameters
+// share a pipeline. The active effect and any enabled overlays form a chain
+// that can also run fused, as one dispatch of a pipeline specialized for it.
+#define FRAME_TIMESTAMP_QUERIES (2 + 2*(MAX_COMPUTE_EFFECTS + 2))
+#define FUSED_EFFECT_CHAIN MAX_COMPUTE_EFFECTS
+#define UPSAMPLED_BACKGROUND (MAX_COMPUTE_EFFECTS + 1)
+#define MAX_RESOLUTION_DIVISOR 4
+
+void initialize_compute_effects(compute_effect_registry *registry, VkPipelineLayout layout, VkPipelineCreateFlags pipeline_flags, char *shader_suffix);
+void deinitialize_compute_effects(compute_effect_registry *registry, VkDevice device);
+
+compute_effect *register_compute_effect(compute_effect_registry *registry, char *name, char *shader_name, background_effect_kind kind, u32 flags,
+                                        effect_parameter *parameters, u32 parameter_count);
+compute_effect *find_compute_effect(compute_effect_registry *registry, char *name);
+b32 select_compute_effect(compute_effect_registry *registry, char *name);
+compute_effect *get_active_compute_effect(compute_effect_registry *registry);
+compute_effect *get_timed_compute_effect(compute_effect_registry *registry, u32 index);
+
+u32 get_effect_chain_divisor(compute_effect_registry *registry);
+VkExtent2D get_compute_effect_extent(VkExtent2D extent, u32 divisor);
+
+void build_effect_chain(compute_effect_registry *registry);
+b32 can_fuse_effect_chain(compute_effect_registry *registry);
+void prepare_effect_chain(compute_effect_registry *registry, VkDevice device, memory_arena *arena);
+
+VkShaderModule get_compute_effect_module(compute_effect_registry *registry, VkDevice device, memory_arena *arena, char *shader_name);
+VkPipeline create_compute_effect_pipeline(compute_effect_registry *registry, VkDevice device, VkShaderModule module, effect_specialization *specialization);
+void prepare_compute_effect(compute_effect_registry *registry, VkDevice device, memory_arena *arena, compute_effect *effect);
+
+void dispatch_compute_effect(command_recorder *recorder, compute_effect *effect, VkExtent2D extent);
+void update_compute_effect_timing(compute_effect *effect, float gpu_ms, u64 frame_index);
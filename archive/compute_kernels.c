@@ -0,0 +1,88 @@
+#include "compute_kernels.h"
+#include "host_allocator.h"
+#include "shaders.h"
+
+void query_subgroup_capabilities(VkPhysicalDevice gpu, subgroup_capabilities *result)
+{
+   memset(result, 0, sizeof(*result));
+
+   VkPhysicalDeviceSubgroupProperties subgroup_properties = {0};
+   subgroup_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+
+   VkPhysicalDeviceProperties2 properties = {0};
+   properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+   properties.pNext = &subgroup_properties;
+   vkGetPhysicalDeviceProperties2(gpu, &properties);
+
+   result->size = subgroup_properties.subgroupSize;
+   result->operations = subgroup_properties.supportedOperations;
+   result->compute_supported = (subgroup_properties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) != 0;
+}
+
+b32 supports_subgroup_operations(subgroup_capabilities *subgroups, VkSubgroupFeatureFlags operations)
+{
+   // NOTE: The kernels move totals between subgroups through shared memory
+   // indexed by subgroup, so a subgroup larger than a workgroup gains
+   // nothing and is treated as unsupported.
+   b32 result = (!subgroups->disabled &&
+                 subgroups->compute_supported &&
+                 subgroups->size > 0 &&
+                 subgroups->size <= COMPUTE_KERNEL_WORKGROUP_SIZE &&
+                 (subgroups->operations & operations) == operations);
+   return(result);
+}
+
+void create_compute_kernel(compute_kernel *kernel, VkDevice device, memory_arena *arena, VkPipelineLayout layout, VkPipelineCreateFlags pipeline_flags,
+                           subgroup_capabilities *subgroups, char *name, VkSubgroupFeatureFlags required_operations)
+{
+   memset(kernel, 0, sizeof(*kernel));
+   kernel->name = name;
+   kernel->required_operations = required_operations;
+   // NOTE: Kernels that need no subgroup operations only have one variant.
+   kernel->uses_subgroups = (required_operations != 0 && supports_subgroup_operations(subgroups, required_operations));
+
+   // NOTE: A module that declares subgroup capabilities must never reach a
+   // device without them, so the variants are separate SPIR-V files rather
+   // than a specialization constant.
+   char path[128];
+   snprintf(path, sizeof(path), "%s%s.comp.spv", name, kernel->uses_subgroups ? ".subgroup" : "");
+   load_shader_module(&kernel->module, device, arena, path);
+
+   VkPipelineShaderStageCreateInfo stage_info = {0};
+   stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+   stage_info.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+   stage_info.module = kernel->module;
+   stage_info.pName = "main";
+
+   VkComputePipelineCreateInfo pipeline_info = {0};
+   pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+   pipeline_info.layout = layout;
+   pipeline_info.flags = pipeline_flags;
+   pipeline_info.stage = stage_info;
+
+   VK_CHECK(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, get_host_allocator(), &kernel->pipeline));
+}
+
+void destroy_compute_kernel(compute_kernel *kernel, VkDevice device)
+{
+   vkDestroyPipeline(device, kernel->pipeline, get_host_allocator());
+   vkDestroyShaderModule(device, kernel->module, get_host_allocator());
+   memset(kernel, 0, sizeof(*kernel));
+}
+
+void record_compute_barrier(VkCommandBuffer cmd)
+{
+   VkMemoryBarrier2 memory_barrier = {0};
+   memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+   memory_barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+   memory_barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+   memory_barrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+   memory_barrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+
+   VkDependencyInfo dependency_info = {0};
+   dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+   dependency_info.memoryBarrierCount = 1;
+   dependency_info.pMemoryBarriers = &memory_barrier;
+
+   vkCmdPipelineBarrier2(cmd, &dependency_info);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "vk.h"
+
+// NOTE: General-purpose compute kernels (reductions, scans, compaction) are
+// built in two variants from the same source: one using subgroup operations
+// and a portable one that only relies on shared memory. The variant is picked
+// once, when the pipeline is created, from what the device reports. Every
+// kernel runs 256 invocations per workgroup, which the shaders assume.
+#define COMPUTE_KERNEL_WORKGROUP_SIZE 256
+
+void query_subgroup_capabilities(VkPhysicalDevice gpu, subgroup_capabilities *result);
+b32 supports_subgroup_operations(subgroup_capabilities *subgroups, VkSubgroupFeatureFlags operations);
+
+void create_compute_kernel(compute_kernel *kernel, VkDevice device, memory_arena *arena, VkPipelineLayout layout, VkPipelineCreateFlags pipeline_flags,
+                           subgroup_capabilities *subgroups, char *name, VkSubgroupFeatureFlags required_operations);
+void destroy_compute_kernel(compute_kernel *kernel, VkDevice device);
+
+void record_compute_barrier(VkCommandBuffer cmd);
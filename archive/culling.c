@@ -0,0 +1,222 @@
+#include <immintrin.h>
+
+#include "culling.h"
+#include "jobs.h"
+
+void initialize_culling_bounds(culling_bounds *bounds, memory_arena *arena, u32 capacity)
+{
+   memset(bounds, 0, sizeof(*bounds));
+
+   bounds->capacity = capacity;
+
+   bounds->center_x = allocate(arena, capacity, float);
+   bounds->center_y = allocate(arena, capacity, float);
+   bounds->center_z = allocate(arena, capacity, float);
+   bounds->extent_x = allocate(arena, capacity, float);
+   bounds->extent_y = allocate(arena, capacity, float);
+   bounds->extent_z = allocate(arena, capacity, float);
+   bounds->radius = allocate(arena, capacity, float);
+
+   bounds->chunk_counts = allocate(arena, capacity/CULLING_CHUNK_SIZE + 1, u32);
+}
+
+void set_culling_box(culling_bounds *bounds, u32 index, mat4 world, vec3 center, vec3 extent)
+{
+   assert(index < bounds->capacity);
+   if(index >= bounds->count) bounds->count = index + 1;
+
+   vec4 world_center = mat4_transform(world, (vec4){center.x, center.y, center.z, 1});
+   bounds->center_x[index] = world_center.x;
+   bounds->center_y[index] = world_center.y;
+   bounds->center_z[index] = world_center.z;
+
+   // NOTE: Transformed box extents, per Arvo.
+   bounds->extent_x[index] = fabsf(world.a.x)*extent.x + fabsf(world.b.x)*extent.y + fabsf(world.c.x)*extent.z;
+   bounds->extent_y[index] = fabsf(world.a.y)*extent.x + fabsf(world.b.y)*extent.y + fabsf(world.c.y)*extent.z;
+   bounds->extent_z[index] = fabsf(world.a.z)*extent.x + fabsf(world.b.z)*extent.y + fabsf(world.c.z)*extent.z;
+   bounds->radius[index] = 0;
+}
+
+void set_culling_sphere(culling_bounds *bounds, u32 index, vec3 center, float radius)
+{
+   assert(index < bounds->capacity);
+   if(index >= bounds->count) bounds->count = index + 1;
+
+   bounds->center_x[index] = center.x;
+   bounds->center_y[index] = center.y;
+   bounds->center_z[index] = center.z;
+   bounds->extent_x[index] = 0;
+   bounds->extent_y[index] = 0;
+   bounds->extent_z[index] = 0;
+   bounds->radius[index] = radius;
+}
+
+culling_frustum extract_culling_frustum(mat4 m)
+{
+   // NOTE: Planes are taken from the rows of the clip matrix, using Vulkan's
+   // 0..w depth range. Plane normals point into the frustum.
+   vec4 row0 = {m.a.x, m.b.x, m.c.x, m.d.x};
+   vec4 row1 = {m.a.y, m.b.y, m.c.y, m.d.y};
+   vec4 row2 = {m.a.z, m.b.z, m.c.z, m.d.z};
+   vec4 row3 = {m.a.w, m.b.w, m.c.w, m.d.w};
+
+   culling_frustum result;
+   result.planes[0] = (vec4){row3.x + row0.x, row3.y + row0.y, row3.z + row0.z, row3.w + row0.w};
+   result.planes[1] = (vec4){row3.x - row0.x, row3.y - row0.y, row3.z - row0.z, row3.w - row0.w};
+   result.planes[2] = (vec4){row3.x + row1.x, row3.y + row1.y, row3.z + row1.z, row3.w + row1.w};
+   result.planes[3] = (vec4){row3.x - row1.x, row3.y - row1.y, row3.z - row1.z, row3.w - row1.w};
+   result.planes[4] = row2;
+   result.planes[5] = (vec4){row3.x - row2.x, row3.y - row2.y, row3.z - row2.z, row3.w - row2.w};
+
+   for(int plane_index = 0; plane_index < countof(result.planes); ++plane_index)
+   {
+      vec4 *plane = result.planes + plane_index;
+      float length = sqrtf(plane->x*plane->x + plane->y*plane->y + plane->z*plane->z);
+      if(length > 0)
+      {
+         plane->x /= length;
+         plane->y /= length;
+         plane->z /= length;
+         plane->w /= length;
+      }
+   }
+
+   return(result);
+}
+
+static u32 cull_range_scalar(culling_bounds *bounds, culling_frustum *frustum, u32 first, u32 last, u32 *visible)
+{
+   u32 result = 0;
+   for(u32 index = first; index < last; ++index)
+   {
+      b32 inside = 1;
+      for(int plane_index = 0; plane_index < 6; ++plane_index)
+      {
+         vec4 plane = frustum->planes[plane_index];
+         float distance = plane.x*bounds->center_x[index] + plane.y*bounds->center_y[index] + plane.z*bounds->center_z[index] + plane.w;
+         float reach = fabsf(plane.x)*bounds->extent_x[index] + fabsf(plane.y)*bounds->extent_y[index] + fabsf(plane.z)*bounds->extent_z[index] + bounds->radius[index];
+         if(distance + reach < 0)
+         {
+            inside = 0;
+            break;
+         }
+      }
+
+      if(inside)
+      {
+         visible[result++] = index;
+      }
+   }
+
+   return(result);
+}
+
+__attribute__((target("avx2")))
+static u32 cull_range_avx2(culling_bounds *bounds, culling_frustum *frustum, u32 first, u32 last, u32 *visible)
+{
+   __m256 plane_x[6], plane_y[6], plane_z[6], plane_w[6];
+   __m256 abs_x[6], abs_y[6], abs_z[6];
+   for(int plane_index = 0; plane_index < 6; ++plane_index)
+   {
+      vec4 plane = frustum->planes[plane_index];
+      plane_x[plane_index] = _mm256_set1_ps(plane.x);
+      plane_y[plane_index] = _mm256_set1_ps(plane.y);
+      plane_z[plane_index] = _mm256_set1_ps(plane.z);
+      plane_w[plane_index] = _mm256_set1_ps(plane.w);
+      abs_x[plane_index] = _mm256_set1_ps(fabsf(plane.x));
+      abs_y[plane_index] = _mm256_set1_ps(fabsf(plane.y));
+      abs_z[plane_index] = _mm256_set1_ps(fabsf(plane.z));
+   }
+
+   __m256 zero = _mm256_setzero_ps();
+
+   u32 result = 0;
+   u32 index = first;
+   for(; index + 8 <= last; index += 8)
+   {
+      __m256 center_x = _mm256_loadu_ps(bounds->center_x + index);
+      __m256 center_y = _mm256_loadu_ps(bounds->center_y + index);
+      __m256 center_z = _mm256_loadu_ps(bounds->center_z + index);
+      __m256 extent_x = _mm256_loadu_ps(bounds->extent_x + index);
+      __m256 extent_y = _mm256_loadu_ps(bounds->extent_y + index);
+      __m256 extent_z = _mm256_loadu_ps(bounds->extent_z + index);
+      __m256 radius = _mm256_loadu_ps(bounds->radius + index);
+
+      __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+      for(int plane_index = 0; plane_index < 6; ++plane_index)
+      {
+         __m256 distance = _mm256_add_ps(_mm256_mul_ps(plane_x[plane_index], center_x), plane_w[plane_index]);
+         distance = _mm256_add_ps(distance, _mm256_mul_ps(plane_y[plane_index], center_y));
+         distance = _mm256_add_ps(distance, _mm256_mul_ps(plane_z[plane_index], center_z));
+
+         __m256 reach = _mm256_add_ps(_mm256_mul_ps(abs_x[plane_index], extent_x), radius);
+         reach = _mm256_add_ps(reach, _mm256_mul_ps(abs_y[plane_index], extent_y));
+         reach = _mm256_add_ps(reach, _mm256_mul_ps(abs_z[plane_index], extent_z));
+
+         inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, reach), zero, _CMP_GE_OQ));
+      }
+
+      u32 mask = (u32)_mm256_movemask_ps(inside);
+      while(mask)
+      {
+         visible[result++] = index + __builtin_ctz(mask);
+         mask &= mask - 1;
+      }
+   }
+
+   result += cull_range_scalar(bounds, frustum, index, last, visible + result);
+
+   return(result);
+}
+
+typedef struct {
+   culling_bounds *bounds;
+   culling_frustum *frustum;
+   u32 *visible;
+   b32 use_avx2;
+} culling_work;
+
+static void cull_chunks(void *data, u32 first_chunk, u32 last_chunk)
+{
+   culling_work *work = data;
+   culling_bounds *bounds = work->bounds;
+
+   for(u32 chunk = first_chunk; chunk < last_chunk; ++chunk)
+   {
+      u32 first = chunk*CULLING_CHUNK_SIZE;
+      u32 last = first + CULLING_CHUNK_SIZE;
+      if(last > bounds->count) last = bounds->count;
+
+      // NOTE: Each chunk writes its visible indices to its own region of the
+      // output, which is compacted once all chunks finish.
+      u32 *visible = work->visible + first;
+      bounds->chunk_counts[chunk] = (work->use_avx2)
+         ? cull_range_avx2(bounds, work->frustum, first, last, visible)
+         : cull_range_scalar(bounds, work->frustum, first, last, visible);
+   }
+}
+
+u32 cull_bounds(culling_bounds *bounds, culling_frustum *frustum, u32 *visible)
+{
+   culling_work work = {0};
+   work.bounds = bounds;
+   work.frustum = frustum;
+   work.visible = visible;
+   work.use_avx2 = !bounds->disable_simd && __builtin_cpu_supports("avx2");
+
+   u32 chunk_count = (bounds->count + CULLING_CHUNK_SIZE - 1) / CULLING_CHUNK_SIZE;
+   parallel_for(chunk_count, 1, cull_chunks, &work);
+
+   u32 result = 0;
+   for(u32 chunk = 0; chunk < chunk_count; ++chunk)
+   {
+      u32 count = bounds->chunk_counts[chunk];
+      if(result != chunk*CULLING_CHUNK_SIZE)
+      {
+         memmove(visible + result, visible + chunk*CULLING_CHUNK_SIZE, count*sizeof(u32));
+      }
+      result += count;
+   }
+
+   return(result);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "vk.h"
+
+#define CULLING_CHUNK_SIZE 4096
+
+typedef struct {
+   vec4 planes[6];
+} culling_frustum;
+
+typedef struct {
+   u32 count;
+   u32 capacity;
+
+   // NOTE: World-space bounds in structure-of-arrays form. An object can be
+   // described by a box (extent), a sphere (radius), or both, in which case
+   // the test is conservative against their sum.
+   float *center_x;
+   float *center_y;
+   float *center_z;
+   float *extent_x;
+   float *extent_y;
+   float *extent_z;
+   float *radius;
+
+   u32 *chunk_counts;
+   b32 disable_simd;
+} culling_bounds;
+
+void initialize_culling_bounds(culling_bounds *bounds, memory_arena *arena, u32 capacity);
+void set_culling_box(culling_bounds *bounds, u32 index, mat4 world, vec3 center, vec3 extent);
+void set_culling_sphere(culling_bounds *bounds, u32 index, vec3 center, float radius);
+
+culling_frustum extract_culling_frustum(mat4 view_projection);
+u32 cull_bounds(culling_bounds *bounds, culling_frustum *frustum, u32 *visible);
@@ -0,0 +1,238 @@
+#include "defragmenter.h"
+#include "host_allocator.h"
+
+#define DEFRAGMENTATION_BYTES_PER_PASS (8*1024*1024)
+#define DEFRAGMENTATION_MIN_WASTE (16*1024*1024)
+
+void initialize_defragmenter(mesh_defragmenter *defragmenter, VmaAllocator allocator)
+{
+   memset(defragmenter, 0, sizeof(*defragmenter));
+
+   // NOTE: The pool's memory type has to suit both vertex and index buffers.
+   VkBufferCreateInfo sample_buffer_info = {0};
+   sample_buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+   sample_buffer_info.size = 1024;
+   sample_buffer_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+      VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+
+   VmaAllocationCreateInfo sample_allocation_info = {0};
+   sample_allocation_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+   u32 memory_type_index;
+   VK_CHECK(vmaFindMemoryTypeIndexForBufferInfo(allocator, &sample_buffer_info, &sample_allocation_info, &memory_type_index));
+
+   VmaPoolCreateInfo pool_info = {0};
+   pool_info.memoryTypeIndex = memory_type_index;
+   VK_CHECK(vmaCreatePool(allocator, &pool_info, &defragmenter->pool));
+}
+
+static void finish_defragmentation(mesh_defragmenter *defragmenter, VmaAllocator allocator)
+{
+   vmaEndDefragmentation(allocator, defragmenter->context, &defragmenter->last_run);
+   defragmenter->context = 0;
+   defragmenter->active = 0;
+   defragmenter->runs++;
+}
+
+static void end_defragmentation_pass(mesh_defragmenter *defragmenter, VkDevice device, VmaAllocator allocator)
+{
+   // NOTE: The copies have executed, so the buffers that were copied from can
+   // go. The moved allocations point at their new memory once the pass ends.
+   for(u32 buffer_index = 0; buffer_index < defragmenter->retired_buffer_count; ++buffer_index)
+   {
+      vkDestroyBuffer(device, defragmenter->retired_buffers[buffer_index], get_host_allocator());
+   }
+   defragmenter->retired_buffer_count = 0;
+   defragmenter->pass_pending = 0;
+   defragmenter->passes++;
+
+   VkResult status = vmaEndDefragmentationPass(allocator, defragmenter->context, &defragmenter->pass);
+   if(status == VK_SUCCESS)
+   {
+      finish_defragmentation(defragmenter, allocator);
+   }
+}
+
+void deinitialize_defragmenter(mesh_defragmenter *defragmenter, VmaAllocator allocator)
+{
+   assert(!defragmenter->active);
+
+   vmaDestroyPool(allocator, defragmenter->pool);
+   memset(defragmenter, 0, sizeof(*defragmenter));
+}
+
+void stop_defragmentation(mesh_defragmenter *defragmenter, VkDevice device, VmaAllocator allocator)
+{
+   // NOTE: Only safe once the device is idle, since a pending pass is ended
+   // without waiting for the frame that recorded it.
+   if(defragmenter->pass_pending)
+   {
+      end_defragmentation_pass(defragmenter, device, allocator);
+   }
+   if(defragmenter->active)
+   {
+      finish_defragmentation(defragmenter, allocator);
+   }
+}
+
+void retire_defragmentation_pass(vulkan_context *vk)
+{
+   mesh_defragmenter *defragmenter = &vk->defragmenter;
+   u64 frames_in_flight = countof(vk->frame_commands);
+
+   if(defragmenter->pass_pending && defragmenter->pass_frame + frames_in_flight <= vk->frame_count)
+   {
+      end_defragmentation_pass(defragmenter, vk->device, vk->allocator);
+
+      for(u32 mesh_index = 0; mesh_index < vk->mesh_count; ++mesh_index)
+      {
+         vulkan_mesh *mesh = vk->meshes + mesh_index;
+         if(mesh->resident)
+         {
+            vmaGetAllocationInfo(vk->allocator, mesh->vertices.allocation, &mesh->vertices.info);
+            vmaGetAllocationInfo(vk->allocator, mesh->indices.allocation, &mesh->indices.info);
+         }
+      }
+   }
+}
+
+static b32 move_mesh_buffer(vulkan_context *vk, VkCommandBuffer cmd, VmaDefragmentationMove *move)
+{
+   VmaAllocationInfo allocation_info;
+   vmaGetAllocationInfo(vk->allocator, move->srcAllocation, &allocation_info);
+
+   vulkan_mesh *mesh = allocation_info.pUserData;
+   assert(mesh && mesh->resident);
+
+   vulkan_buffer *buffer = (mesh->vertices.allocation == move->srcAllocation) ? &mesh->vertices : &mesh->indices;
+   assert(buffer->allocation == move->srcAllocation);
+
+   VkBufferCreateInfo buffer_info = {0};
+   buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+   buffer_info.size = buffer->size;
+   buffer_info.usage = buffer->usage;
+
+   VkBuffer new_buffer;
+   if(vkCreateBuffer(vk->device, &buffer_info, get_host_allocator(), &new_buffer) != VK_SUCCESS)
+   {
+      return(0);
+   }
+   if(vmaBindBufferMemory(vk->allocator, move->dstTmpAllocation, new_buffer) != VK_SUCCESS)
+   {
+      vkDestroyBuffer(vk->device, new_buffer, get_host_allocator());
+      return(0);
+   }
+
+   VkBufferCopy copy = {0};
+   copy.size = buffer->size;
+   vkCmdCopyBuffer(cmd, buffer->buffer, new_buffer, 1, &copy);
+
+   // NOTE: Draws later in this frame already use the new buffer. The old one
+   // is still read by the copy and possibly by the previous frame, so it lives
+   // until the pass retires, and so must the mesh.
+   assert(vk->defragmenter.retired_buffer_count < MAX_DEFRAGMENTATION_MOVES);
+   vk->defragmenter.retired_buffers[vk->defragmenter.retired_buffer_count++] = buffer->buffer;
+   buffer->buffer = new_buffer;
+   mesh->last_used_frame = vk->frame_count;
+
+   if(buffer == &mesh->vertices)
+   {
+      VkBufferDeviceAddressInfo address_info = {0};
+      address_info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+      address_info.buffer = new_buffer;
+      mesh->vertex_address = vkGetBufferDeviceAddress(vk->device, &address_info);
+   }
+
+   return(1);
+}
+
+void run_defragmentation_pass(vulkan_context *vk, VkCommandBuffer cmd)
+{
+   mesh_defragmenter *defragmenter = &vk->defragmenter;
+   if(defragmenter->pass_pending)
+   {
+      return;
+   }
+
+   VmaStatistics pool_statistics;
+   vmaGetPoolStatistics(vk->allocator, defragmenter->pool, &pool_statistics);
+   defragmenter->block_bytes = pool_statistics.blockBytes;
+   defragmenter->allocation_bytes = pool_statistics.allocationBytes;
+
+   if(!defragmenter->active)
+   {
+      // NOTE: Start on request, or on our own once a quarter of the pool's
+      // blocks is sitting unused between allocations.
+      VkDeviceSize waste = defragmenter->block_bytes - defragmenter->allocation_bytes;
+      b32 fragmented = (waste >= DEFRAGMENTATION_MIN_WASTE && waste*4 >= defragmenter->block_bytes);
+      if(!defragmenter->requested && !fragmented)
+      {
+         return;
+      }
+
+      VmaDefragmentationInfo defragmentation_info = {0};
+      defragmentation_info.pool = defragmenter->pool;
+      defragmentation_info.maxBytesPerPass = DEFRAGMENTATION_BYTES_PER_PASS;
+      defragmentation_info.maxAllocationsPerPass = MAX_DEFRAGMENTATION_MOVES;
+      VK_CHECK(vmaBeginDefragmentation(vk->allocator, &defragmentation_info, &defragmenter->context));
+
+      defragmenter->requested = 0;
+      defragmenter->active = 1;
+   }
+
+   VkResult status = vmaBeginDefragmentationPass(vk->allocator, defragmenter->context, &defragmenter->pass);
+   if(status == VK_SUCCESS)
+   {
+      finish_defragmentation(defragmenter, vk->allocator);
+      return;
+   }
+   assert(status == VK_INCOMPLETE);
+
+   if(defragmenter->pass.moveCount > 0)
+   {
+      // NOTE: A move source may have been streamed in by an earlier frame
+      // whose copies are still in flight.
+      VkMemoryBarrier2 memory_barrier = {0};
+      memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+      memory_barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+      memory_barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+      memory_barrier.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+      memory_barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
+
+      VkDependencyInfo dependency_info = {0};
+      dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+      dependency_info.memoryBarrierCount = 1;
+      dependency_info.pMemoryBarriers = &memory_barrier;
+
+      vkCmdPipelineBarrier2(cmd, &dependency_info);
+   }
+
+   for(u32 move_index = 0; move_index < defragmenter->pass.moveCount; ++move_index)
+   {
+      VmaDefragmentationMove *move = defragmenter->pass.pMoves + move_index;
+      if(!move_mesh_buffer(vk, cmd, move))
+      {
+         move->operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+      }
+   }
+
+   if(defragmenter->retired_buffer_count > 0)
+   {
+      VkMemoryBarrier2 memory_barrier = {0};
+      memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+      memory_barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+      memory_barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+      memory_barrier.dstStageMask = VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT;
+      memory_barrier.dstAccessMask = VK_ACCESS_2_INDEX_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+
+      VkDependencyInfo dependency_info = {0};
+      dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+      dependency_info.memoryBarrierCount = 1;
+      dependency_info.pMemoryBarriers = &memory_barrier;
+
+      vkCmdPipelineBarrier2(cmd, &dependency_info);
+   }
+
+   defragmenter->pass_pending = 1;
+   defragmenter->pass_frame = vk->frame_count;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "vk.h"
+
+// NOTE: Incremental defragmentation of the mesh pool. Each pass moves a
+// bounded number of allocations by recording copies into the frame's command
+// buffer, and is finished once the frame that recorded it has retired. Moved
+// meshes get their buffers and vertex addresses patched in place; nothing
+// refers to mesh buffers through descriptors, so there are none to rewrite.
+void initialize_defragmenter(mesh_defragmenter *defragmenter, VmaAllocator allocator);
+void deinitialize_defragmenter(mesh_defragmenter *defragmenter, VmaAllocator allocator);
+void stop_defragmentation(mesh_defragmenter *defragmenter, VkDevice device, VmaAllocator allocator);
+
+void retire_defragmentation_pass(vulkan_context *vk);
+void run_defragmentation_pass(vulkan_context *vk, VkCommandBuffer cmd);
@@ -0,0 +1,140 @@
+#include "descriptor_allocator.h"
+#include "host_allocator.h"
+
+#define DESCRIPTOR_POOL_MAX_SETS 4096
+
+static VkDescriptorPool create_descriptor_pool(descriptor_allocator *allocator, VkDevice device, u32 set_count)
+{
+   VkDescriptorPoolSize pool_sizes[MAX_DESCRIPTOR_POOL_RATIOS] = {0};
+   for(u32 ratio_index = 0; ratio_index < allocator->ratio_count; ++ratio_index)
+   {
+      descriptor_pool_ratio *ratio = allocator->ratios + ratio_index;
+      pool_sizes[ratio_index].type = ratio->type;
+      pool_sizes[ratio_index].descriptorCount = (u32)(ratio->ratio * set_count);
+      if(pool_sizes[ratio_index].descriptorCount == 0)
+      {
+         pool_sizes[ratio_index].descriptorCount = 1;
+      }
+   }
+
+   VkDescriptorPoolCreateInfo pool_info = {0};
+   pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+   pool_info.maxSets = set_count;
+   pool_info.poolSizeCount = allocator->ratio_count;
+   pool_info.pPoolSizes = pool_sizes;
+
+   VkDescriptorPool result;
+   VK_CHECK(vkCreateDescriptorPool(device, &pool_info, get_host_allocator(), &result));
+
+   allocator->stats.pool_count++;
+
+   return(result);
+}
+
+static VkDescriptorPool get_descriptor_pool(descriptor_allocator *allocator, VkDevice device)
+{
+   VkDescriptorPool result;
+   if(allocator->ready_pool_count > 0)
+   {
+      result = allocator->ready_pools[--allocator->ready_pool_count];
+   }
+   else
+   {
+      // NOTE: Each new pool is half again as large as the last, so a frame
+      // that needs many sets converges on a few big pools.
+      result = create_descriptor_pool(allocator, device, allocator->sets_per_pool);
+
+      allocator->sets_per_pool += allocator->sets_per_pool / 2;
+      if(allocator->sets_per_pool > DESCRIPTOR_POOL_MAX_SETS)
+      {
+         allocator->sets_per_pool = DESCRIPTOR_POOL_MAX_SETS;
+      }
+   }
+
+   return(result);
+}
+
+void initialize_descriptor_allocator(descriptor_allocator *allocator, VkDevice device, u32 initial_sets, descriptor_pool_ratio *ratios, u32 ratio_count)
+{
+   assert(ratio_count <= MAX_DESCRIPTOR_POOL_RATIOS);
+
+   memset(allocator, 0, sizeof(*allocator));
+   allocator->ratio_count = ratio_count;
+   memcpy(allocator->ratios, ratios, ratio_count*sizeof(*ratios));
+   allocator->sets_per_pool = initial_sets;
+
+   allocator->ready_pools[allocator->ready_pool_count++] = get_descriptor_pool(allocator, device);
+}
+
+void deinitialize_descriptor_allocator(descriptor_allocator *allocator, VkDevice device)
+{
+   for(u32 pool_index = 0; pool_index < allocator->ready_pool_count; ++pool_index)
+   {
+      vkDestroyDescriptorPool(device, allocator->ready_pools[pool_index], get_host_allocator());
+   }
+   for(u32 pool_index = 0; pool_index < allocator->full_pool_count; ++pool_index)
+   {
+      vkDestroyDescriptorPool(device, allocator->full_pools[pool_index], get_host_allocator());
+   }
+
+   memset(allocator, 0, sizeof(*allocator));
+}
+
+void reset_descriptor_allocator(descriptor_allocator *allocator, VkDevice device)
+{
+   // NOTE: Only call once the frame that used these sets has retired.
+   for(u32 pool_index = 0; pool_index < allocator->ready_pool_count; ++pool_index)
+   {
+      VK_CHECK(vkResetDescriptorPool(device, allocator->ready_pools[pool_index], 0));
+   }
+   for(u32 pool_index = 0; pool_index < allocator->full_pool_count; ++pool_index)
+   {
+      VK_CHECK(vkResetDescriptorPool(device, allocator->full_pools[pool_index], 0));
+      allocator->ready_pools[allocator->ready_pool_count++] = allocator->full_pools[pool_index];
+   }
+   allocator->full_pool_count = 0;
+
+   if(allocator->stats.allocated_sets > allocator->stats.peak_sets)
+   {
+      allocator->stats.peak_sets = allocator->stats.allocated_sets;
+   }
+   allocator->stats.allocated_sets = 0;
+   allocator->stats.pools_used = 0;
+}
+
+VkDescriptorSet allocate_descriptor_set(descriptor_allocator *allocator, VkDevice device, VkDescriptorSetLayout layout, void *next)
+{
+   VkDescriptorPool pool = get_descriptor_pool(allocator, device);
+
+   VkDescriptorSetAllocateInfo allocation_info = {0};
+   allocation_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+   allocation_info.pNext = next;
+   allocation_info.descriptorPool = pool;
+   allocation_info.descriptorSetCount = 1;
+   allocation_info.pSetLayouts = &layout;
+
+   VkDescriptorSet result;
+   VkResult status = vkAllocateDescriptorSets(device, &allocation_info, &result);
+   if(status == VK_ERROR_OUT_OF_POOL_MEMORY || status == VK_ERROR_FRAGMENTED_POOL)
+   {
+      // NOTE: This pool is exhausted. Park it until the next reset and retry
+      // once from a fresh one.
+      assert(allocator->full_pool_count < MAX_DESCRIPTOR_POOLS);
+      allocator->full_pools[allocator->full_pool_count++] = pool;
+
+      pool = get_descriptor_pool(allocator, device);
+      allocation_info.descriptorPool = pool;
+      status = vkAllocateDescriptorSets(device, &allocation_info, &result);
+   }
+   VK_CHECK(status);
+
+   // NOTE: The pool goes back on top of the ready list, so the next
+   // allocation keeps filling it.
+   assert(allocator->ready_pool_count < MAX_DESCRIPTOR_POOLS);
+   allocator->ready_pools[allocator->ready_pool_count++] = pool;
+
+   allocator->stats.allocated_sets++;
+   allocator->stats.pools_used = allocator->full_pool_count + 1;
+
+   return(result);
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "vk.h"
+
+// NOTE: Hands out short-lived descriptor sets from a list of pools, each sized
+// from a set count and a per-type ratio. When the current pool runs out a new,
+// larger one is started. Resetting returns every set at once and keeps the
+// pools, so after warm-up allocation never creates a pool.
+void initialize_descriptor_allocator(descriptor_allocator *allocator, VkDevice device, u32 initial_sets, descriptor_pool_ratio *ratios, u32 ratio_count);
+void deinitialize_descriptor_allocator(descriptor_allocator *allocator, VkDevice device);
+void reset_descriptor_allocator(descriptor_allocator *allocator, VkDevice device);
+
+VkDescriptorSet allocate_descriptor_set(descriptor_allocator *allocator, VkDevice device, VkDescriptorSetLayout layout, void *next);
@@ -0,0 +1,104 @@
+#include "draw_list.h"
+
+void initialize_draw_list(draw_list *list, memory_arena *arena, u32 capacity)
+{
+   memset(list, 0, sizeof(*list));
+   list->capacity = capacity;
+   list->items = allocate(arena, capacity, draw_item);
+   list->scratch = allocate(arena, capacity, draw_item);
+}
+
+void clear_draw_list(draw_list *list)
+{
+   list->count = 0;
+}
+
+u64 make_draw_key(render_pass pass, u32 pipeline, u32 material, u32 mesh, float depth)
+{
+   assert(pass < (1 << 4));
+   assert(pipeline < (1 << 12));
+   assert(material < (1 << 16));
+   assert(mesh < (1 << 16));
+
+   if(depth < 0) depth = 0;
+   if(depth > 1) depth = 1;
+
+   // NOTE: Opaque draws go front to back to help early depth rejection, while
+   // blended draws have to go back to front.
+   u32 depth_bucket = (u32)(depth * 65535.0f);
+   if(pass == RENDER_PASS_TRANSPARENT)
+   {
+      depth_bucket = 65535 - depth_bucket;
+   }
+
+   u64 result = 0;
+   result |= (u64)pass << DRAW_KEY_PASS_SHIFT;
+   result |= (u64)pipeline << DRAW_KEY_PIPELINE_SHIFT;
+   result |= (u64)material << DRAW_KEY_MATERIAL_SHIFT;
+   result |= (u64)mesh << DRAW_KEY_MESH_SHIFT;
+   result |= (u64)depth_bucket << DRAW_KEY_DEPTH_SHIFT;
+
+   return(result);
+}
+
+void push_draw(draw_list *list, u64 key, u32 object_index, u32 transform_index)
+{
+   assert(list->count < list->capacity);
+
+   draw_item *item = list->items + list->count++;
+   item->key = key;
+   item->object_index = object_index;
+   item->transform_index = transform_index;
+}
+
+void sort_draw_list(draw_list *list)
+{
+   // NOTE: Least-significant-digit radix sort, one byte per pass. Passes where
+   // every key shares the same digit are skipped, which is common since the
+   // upper fields only take a handful of distinct values.
+   if(list->count < 2)
+   {
+      return;
+   }
+
+   draw_item *source = list->items;
+   draw_item *dest = list->scratch;
+
+   for(u32 shift = 0; shift < 64; shift += 8)
+   {
+      u32 counts[256] = {0};
+      for(u32 index = 0; index < list->count; ++index)
+      {
+         counts[(source[index].key >> shift) & 0xFF]++;
+      }
+
+      u32 first_digit = (source[0].key >> shift) & 0xFF;
+      if(counts[first_digit] == list->count)
+      {
+         continue;
+      }
+
+      u32 offsets[256];
+      u32 total = 0;
+      for(u32 digit = 0; digit < 256; ++digit)
+      {
+         offsets[digit] = total;
+         total += counts[digit];
+      }
+
+      for(u32 index = 0; index < list->count; ++index)
+      {
+         u32 digit = (source[index].key >> shift) & 0xFF;
+         dest[offsets[digit]++] = source[index];
+      }
+
+      draw_item *swap = source;
+      source = dest;
+      dest = swap;
+   }
+
+   if(source != list->items)
+   {
+      memcpy(list->items, source, list->count*sizeof(draw_item));
+   }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "vk.h"
+
+// NOTE: Sort keys are laid out from most to least significant as
+//   pass (4 bits) | pipeline (12) | material (16) | mesh (16) | depth (16)
+// so that sorting groups draws by the state that is most expensive to change.
+#define DRAW_KEY_PASS_SHIFT     60
+#define DRAW_KEY_PIPELINE_SHIFT 48
+#define DRAW_KEY_MATERIAL_SHIFT 32
+#define DRAW_KEY_MESH_SHIFT     16
+#define DRAW_KEY_DEPTH_SHIFT    0
+
+typedef struct {
+   u64 key;
+   u32 object_index;
+   u32 transform_index;
+} draw_item;
+
+typedef struct {
+   u32 count;
+   u32 capacity;
+
+   draw_item *items;
+   draw_item *scratch;
+} draw_list;
+
+void initialize_draw_list(draw_list *list, memory_arena *arena, u32 capacity);
+void clear_draw_list(draw_list *list);
+
+u64 make_draw_key(render_pass pass, u32 pipeline, u32 material, u32 mesh, float depth);
+void push_draw(draw_list *list, u64 key, u32 object_index, u32 transform_index);
+void sort_draw_list(draw_list *list);
@@ -0,0 +1,111 @@
+#include "dynamic_resolution.h"
+
+#include <math.h>
+
+void initialize_dynamic_resolution(dynamic_resolution *resolution, float target_ms, float min_scale, float max_scale)
+{
+   memset(resolution, 0, sizeof(*resolution));
+
+   resolution->enabled = 1;
+   resolution->target_ms = target_ms;
+   resolution->min_scale = min_scale;
+   resolution->max_scale = max_scale;
+   resolution->scale = max_scale;
+}
+
+static float clamp_scale(dynamic_resolution *resolution, float scale)
+{
+   float result = scale;
+   if(result < resolution->min_scale) result = resolution->min_scale;
+   if(result > resolution->max_scale) result = resolution->max_scale;
+
+   return(result);
+}
+
+void update_dynamic_resolution(dynamic_resolution *resolution, float gpu_ms)
+{
+   if(gpu_ms <= 0.0f)
+   {
+      return;
+   }
+
+   resolution->gpu_ms = gpu_ms;
+   if(resolution->smoothed_gpu_ms <= 0.0f)
+   {
+      resolution->smoothed_gpu_ms = gpu_ms;
+   }
+   else
+   {
+      resolution->smoothed_gpu_ms += 0.1f*(gpu_ms - resolution->smoothed_gpu_ms);
+   }
+
+   // NOTE: The limits can be edited at runtime, so the current scale is pulled
+   // back inside them even while the controller is settling or disabled.
+   resolution->scale = clamp_scale(resolution, resolution->scale);
+   if(!resolution->enabled)
+   {
+      return;
+   }
+
+   // NOTE: A new scale takes a couple of frames in flight to show up in the
+   // timings, so hold off instead of reacting to the same overload twice.
+   if(resolution->settle_frames > 0)
+   {
+      resolution->settle_frames--;
+      return;
+   }
+
+   // NOTE: A single spike is reacted to straight away, while only a sustained
+   // drop in the smoothed time is allowed to raise the scale again.
+   float measured_ms = resolution->smoothed_gpu_ms;
+   if(gpu_ms > measured_ms)
+   {
+      measured_ms = gpu_ms;
+   }
+
+   float ratio = resolution->target_ms / measured_ms;
+   if(fabsf(ratio - 1.0f) < DYNAMIC_RESOLUTION_DEADBAND)
+   {
+      return;
+   }
+
+   // NOTE: GPU time scales roughly with pixel count, which goes with the square
+   // of the per-axis scale.
+   float desired = resolution->scale * sqrtf(ratio);
+   if(desired > resolution->scale)
+   {
+      desired = resolution->scale + 0.25f*(desired - resolution->scale);
+   }
+
+   desired = clamp_scale(resolution, desired);
+   if(fabsf(desired - resolution->scale) > 0.005f)
+   {
+      resolution->scale = desired;
+      resolution->settle_frames = DYNAMIC_RESOLUTION_SETTLE_FRAMES;
+   }
+}
+
+static u32 scale_dimension(u32 full, float scale)
+{
+   // NOTE: Rounding to a multiple of the granularity stops the extent
+   // jittering by single pixels as the scale drifts.
+   u32 result = (u32)(full*scale + 0.5f);
+   result = (result + DYNAMIC_RESOLUTION_GRANULARITY/2) / DYNAMIC_RESOLUTION_GRANULARITY * DYNAMIC_RESOLUTION_GRANULARITY;
+
+   if(result < DYNAMIC_RESOLUTION_GRANULARITY) result = DYNAMIC_RESOLUTION_GRANULARITY;
+   if(result > full) result = full;
+
+   return(result);
+}
+
+VkExtent2D get_dynamic_resolution_extent(dynamic_resolution *resolution, VkExtent2D full_extent)
+{
+   VkExtent2D result = full_extent;
+   if(resolution->enabled)
+   {
+      result.width = scale_dimension(full_extent.width, resolution->scale);
+      result.height = scale_dimension(full_extent.height, resolution->scale);
+   }
+
+   return(result);
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "vk.h"
+
+// NOTE: The render scale is steered by the measured GPU time of each frame so
+// the draw image is only filled as far as the frame time target allows. The
+// draw image itself keeps its full size; only draw_extent moves.
+#define DYNAMIC_RESOLUTION_DEADBAND 0.05f
+#define DYNAMIC_RESOLUTION_SETTLE_FRAMES 8
+#define DYNAMIC_RESOLUTION_GRANULARITY 8
+
+void initialize_dynamic_resolution(dynamic_resolution *resolution, float target_ms, float min_scale, float max_scale);
+void update_dynamic_resolution(dynamic_resolution *resolution, float gpu_ms);
+VkExtent2D get_dynamic_resolution_extent(dynamic_resolution *resolution, VkExtent2D full_extent);
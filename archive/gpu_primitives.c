@@ -0,0 +1,214 @@
+#include "gpu_primitives.h"
+#include "bindless.h"
+#include "host_allocator.h"
+#include "memory_budget.h"
+
+static VkDeviceSize align_scratch_offset(VkDeviceSize offset)
+{
+   VkDeviceSize result = (offset + 15) & ~(VkDeviceSize)15;
+   return(result);
+}
+
+void initialize_gpu_primitives(gpu_primitives *primitives, vulkan_context *vk, u32 capacity)
+{
+   memset(primitives, 0, sizeof(*primitives));
+
+   // NOTE: The scan only needs 32-bit integer arithmetic in its subgroup
+   // variant, while the sort ranks keys with ballots.
+   VkSubgroupFeatureFlags arithmetic = VK_SUBGROUP_FEATURE_BASIC_BIT|VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+   VkPipelineLayout layout = vk->bindless.pipeline_layout;
+   VkPipelineCreateFlags flags = vk->bindless.pipeline_flags;
+   create_compute_kernel(&primitives->scan, vk->device, vk->scratch_arena, layout, flags, &vk->subgroups, "scan", arithmetic);
+   create_compute_kernel(&primitives->radix_histogram, vk->device, vk->scratch_arena, layout, flags, &vk->subgroups, "radix_histogram", 0);
+   create_compute_kernel(&primitives->radix_scatter, vk->device, vk->scratch_arena, layout, flags, &vk->subgroups, "radix_scatter",
+                         arithmetic|VK_SUBGROUP_FEATURE_BALLOT_BIT);
+
+   // NOTE: The sort scans its histograms, which can outnumber the elements
+   // being sorted when there are only a few per tile.
+   u32 max_sort_tiles = (capacity + PRIMITIVE_TILE_SIZE - 1) / PRIMITIVE_TILE_SIZE;
+   u32 histogram_count = RADIX_SORT_BINS*max_sort_tiles;
+   u32 max_scan_count = (histogram_count > capacity) ? histogram_count : capacity;
+   u32 max_scan_tiles = (max_scan_count + PRIMITIVE_TILE_SIZE - 1) / PRIMITIVE_TILE_SIZE;
+
+   primitives->capacity = capacity;
+   primitives->status_offset = 0;
+   primitives->status_size = (1 + max_scan_tiles)*sizeof(u32);
+   primitives->total_offset = align_scratch_offset(primitives->status_offset + primitives->status_size);
+   primitives->histogram_offset = align_scratch_offset(primitives->total_offset + sizeof(u32));
+   primitives->keys_offset = align_scratch_offset(primitives->histogram_offset + histogram_count*sizeof(u32));
+   primitives->values_offset = align_scratch_offset(primitives->keys_offset + (VkDeviceSize)capacity*sizeof(u64));
+   VkDeviceSize scratch_size = primitives->values_offset + (VkDeviceSize)capacity*sizeof(u32);
+
+   create_compute_buffer(&primitives->scratch, vk->allocator, vk->device, scratch_size, VMA_MEMORY_USAGE_GPU_ONLY);
+}
+
+void deinitialize_gpu_primitives(gpu_primitives *primitives, vulkan_context *vk)
+{
+   destroy_compute_buffer(&primitives->scratch, vk->allocator);
+   destroy_compute_kernel(&primitives->scan, vk->device);
+   destroy_compute_kernel(&primitives->radix_histogram, vk->device);
+   destroy_compute_kernel(&primitives->radix_scatter, vk->device);
+   memset(primitives, 0, sizeof(*primitives));
+}
+
+void create_compute_buffer(compute_buffer *buffer, VmaAllocator allocator, VkDevice device, VkDeviceSize size, VmaMemoryUsage memory_usage)
+{
+   memset(buffer, 0, sizeof(*buffer));
+
+   VkBufferCreateInfo buffer_info = {0};
+   buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+   buffer_info.size = size;
+   buffer_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT|VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+   buffer_info.usage |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT|VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+   VmaAllocationCreateInfo allocation_info = {0};
+   allocation_info.usage = memory_usage;
+   if(memory_usage != VMA_MEMORY_USAGE_GPU_ONLY)
+   {
+      allocation_info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+   }
+
+   VmaAllocationInfo allocation_result;
+   VK_CHECK(vmaCreateBuffer(allocator, &buffer_info, &allocation_info, &buffer->buffer, &buffer->allocation, &allocation_result));
+   track_memory_allocation(allocator, buffer->allocation, MEMORY_SUBSYSTEM_COMPUTE);
+
+   buffer->memory = allocation_result.pMappedData;
+   buffer->size = size;
+
+   VkBufferDeviceAddressInfo address_info = {0};
+   address_info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+   address_info.buffer = buffer->buffer;
+   buffer->address = vkGetBufferDeviceAddress(device, &address_info);
+}
+
+void destroy_compute_buffer(compute_buffer *buffer, VmaAllocator allocator)
+{
+   untrack_memory_allocation(allocator, buffer->allocation, MEMORY_SUBSYSTEM_COMPUTE);
+   vmaDestroyBuffer(allocator, buffer->buffer, buffer->allocation);
+   memset(buffer, 0, sizeof(*buffer));
+}
+
+void record_transfer_barrier(VkCommandBuffer cmd)
+{
+   // NOTE: Orders compute and transfer work against each other in both
+   // directions, e.g. a fill before the kernel reading it, or a copy of a
+   // kernel's results.
+   VkMemoryBarrier2 memory_barrier = {0};
+   memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+   memory_barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+   memory_barrier.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT;
+   memory_barrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+   memory_barrier.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+   VkDependencyInfo dependency_info = {0};
+   dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+   dependency_info.memoryBarrierCount = 1;
+   dependency_info.pMemoryBarriers = &memory_barrier;
+
+   vkCmdPipelineBarrier2(cmd, &dependency_info);
+}
+
+static void record_scan(gpu_primitives *primitives, vulkan_context *vk, command_recorder *recorder, scan_push_constants *push_constants)
+{
+   VkCommandBuffer cmd = recorder->cmd;
+   u32 tile_count = (push_constants->count + PRIMITIVE_TILE_SIZE - 1) / PRIMITIVE_TILE_SIZE;
+
+   // NOTE: Tiles take their index from the counter in the first word rather
+   // than their workgroup ID, so a tile only ever waits on tiles that have
+   // already started. Both the counter and the tile states start out zeroed.
+   VkDeviceSize status_size = (1 + tile_count)*sizeof(u32);
+   assert(status_size <= primitives->status_size);
+   vkCmdFillBuffer(cmd, primitives->scratch.buffer, primitives->status_offset, status_size, 0);
+   record_transfer_barrier(cmd);
+
+   push_constants->status = primitives->scratch.address + primitives->status_offset;
+   if(!push_constants->total)
+   {
+      push_constants->total = primitives->scratch.address + primitives->total_offset;
+   }
+
+   record_bind_pipeline(recorder, VK_PIPELINE_BIND_POINT_COMPUTE, primitives->scan.pipeline);
+   push_bindless_constants(recorder, &vk->bindless, sizeof(*push_constants), push_constants);
+   vkCmdDispatch(cmd, tile_count, 1, 1);
+   record_transfer_barrier(cmd);
+}
+
+void record_exclusive_scan(gpu_primitives *primitives, vulkan_context *vk, command_recorder *recorder,
+                           VkDeviceAddress input, VkDeviceAddress output, VkDeviceAddress total, u32 count)
+{
+   assert(count > 0);
+
+   scan_push_constants push_constants = {0};
+   push_constants.input = input;
+   push_constants.output = output;
+   push_constants.total = total;
+   push_constants.count = count;
+   push_constants.mode = SCAN_MODE_EXCLUSIVE;
+   record_scan(primitives, vk, recorder, &push_constants);
+}
+
+void record_stream_compaction(gpu_primitives *primitives, vulkan_context *vk, command_recorder *recorder,
+                              VkDeviceAddress input, VkDeviceAddress flags, VkDeviceAddress output, VkDeviceAddress output_count, u32 count)
+{
+   assert(count > 0);
+   assert(input != output);
+
+   // NOTE: The same single pass as the scan, except that it scans the flags
+   // and scatters each kept value to its prefix.
+   scan_push_constants push_constants = {0};
+   push_constants.input = input;
+   push_constants.output = output;
+   push_constants.flags = flags;
+   push_constants.total = output_count;
+   push_constants.count = count;
+   push_constants.mode = SCAN_MODE_COMPACT;
+   record_scan(primitives, vk, recorder, &push_constants);
+}
+
+void record_radix_sort(gpu_primitives *primitives, vulkan_context *vk, command_recorder *recorder,
+                       VkDeviceAddress keys, VkDeviceAddress values, u32 count, u32 key_bits)
+{
+   assert(key_bits == 32 || key_bits == 64);
+   assert(count > 0 && count <= primitives->capacity);
+
+   VkCommandBuffer cmd = recorder->cmd;
+   u32 tile_count = (count + PRIMITIVE_TILE_SIZE - 1) / PRIMITIVE_TILE_SIZE;
+   u32 pass_count = key_bits / RADIX_SORT_DIGIT_BITS;
+
+   VkDeviceAddress histogram = primitives->scratch.address + primitives->histogram_offset;
+   VkDeviceAddress scratch_keys = primitives->scratch.address + primitives->keys_offset;
+   VkDeviceAddress scratch_values = primitives->scratch.address + primitives->values_offset;
+
+   radix_sort_push_constants push_constants = {0};
+   push_constants.histogram = histogram;
+   push_constants.count = count;
+   push_constants.tile_count = tile_count;
+   push_constants.key_words = key_bits / 32;
+   push_constants.has_values = (values != 0);
+
+   // NOTE: Each pass counts its digit per tile, scans the counts in digit-major
+   // order so every (digit, tile) pair gets its output offset, then scatters.
+   // The pass count is always even, so the last one writes back into the
+   // caller's buffers.
+   for(u32 pass = 0; pass < pass_count; ++pass)
+   {
+      b32 from_caller = ((pass & 1) == 0);
+      push_constants.keys_in = from_caller ? keys : scratch_keys;
+      push_constants.values_in = from_caller ? values : scratch_values;
+      push_constants.keys_out = from_caller ? scratch_keys : keys;
+      push_constants.values_out = from_caller ? scratch_values : values;
+      push_constants.digit = pass;
+
+      record_bind_pipeline(recorder, VK_PIPELINE_BIND_POINT_COMPUTE, primitives->radix_histogram.pipeline);
+      push_bindless_constants(recorder, &vk->bindless, sizeof(push_constants), &push_constants);
+      vkCmdDispatch(cmd, tile_count, 1, 1);
+      record_transfer_barrier(cmd);
+
+      record_exclusive_scan(primitives, vk, recorder, histogram, histogram, 0, RADIX_SORT_BINS*tile_count);
+
+      record_bind_pipeline(recorder, VK_PIPELINE_BIND_POINT_COMPUTE, primitives->radix_scatter.pipeline);
+      push_bindless_constants(recorder, &vk->bindless, sizeof(push_constants), &push_constants);
+      vkCmdDispatch(cmd, tile_count, 1, 1);
+      record_transfer_barrier(cmd);
+   }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "vk.h"
+#include "command_recorder.h"
+#include "compute_kernels.h"
+
+// NOTE: Every primitive works on tiles of four elements per invocation. The
+// scan carries tile totals in 30 bits next to a 2 bit look-back state, so
+// the sum of everything it scans must stay below 2^30. The sort moves 8 bits
+// per pass, four passes for 32 bit keys and eight for 64 bit ones, and ends
+// up back in the caller's buffers.
+#define PRIMITIVE_TILE_SIZE (4*COMPUTE_KERNEL_WORKGROUP_SIZE)
+#define PRIMITIVE_MAX_SCAN_TOTAL (1u << 30)
+#define RADIX_SORT_BINS 256
+#define RADIX_SORT_DIGIT_BITS 8
+
+void initialize_gpu_primitives(gpu_primitives *primitives, vulkan_context *vk, u32 capacity);
+void deinitialize_gpu_primitives(gpu_primitives *primitives, vulkan_context *vk);
+
+void create_compute_buffer(compute_buffer *buffer, VmaAllocator allocator, VkDevice device, VkDeviceSize size, VmaMemoryUsage memory_usage);
+void destroy_compute_buffer(compute_buffer *buffer, VmaAllocator allocator);
+void record_transfer_barrier(VkCommandBuffer cmd);
+
+// NOTE: The output can alias the input. The total, if wanted, is written as
+// a single u32.
+void record_exclusive_scan(gpu_primitives *primitives, vulkan_context *vk, command_recorder *recorder,
+                           VkDeviceAddress input, VkDeviceAddress output, VkDeviceAddress total, u32 count);
+
+// NOTE: Keeps the input values whose flag is non-zero, in order. The output
+// must not alias the input, and the kept count is written as a single u32.
+void record_stream_compaction(gpu_primitives *primitives, vulkan_context *vk, command_recorder *recorder,
+                              VkDeviceAddress input, VkDeviceAddress flags, VkDeviceAddress output, VkDeviceAddress output_count, u32 count);
+
+// NOTE: Stable sort of u32 or u64 keys, optionally carrying a u32 value per
+// key (pass 0 for keys only), in place.
+void record_radix_sort(gpu_primitives *primitives, vulkan_context *vk, command_recorder *recorder,
+                       VkDeviceAddress keys, VkDeviceAddress values, u32 count, u32 key_bits);
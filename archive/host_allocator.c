@@ -0,0 +1,197 @@
+#include "host_allocator.h"
+
+#define HOST_POOL_CLASS_COUNT 7
+#define HOST_POOL_MIN_SIZE 64
+#define HOST_POOL_NONE 0xFFFFFFFF
+#define HOST_POOL_ALIGNMENT 16
+
+typedef struct {
+   void *block;
+   size_t size;
+   u32 scope;
+   u32 size_class;
+   u8 padding[8];
+} host_allocation_header;
+
+static host_allocation_stats host_stats;
+static __thread void *host_free_lists[HOST_POOL_CLASS_COUNT];
+
+static u32 get_host_pool_class(size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+   u32 result = HOST_POOL_NONE;
+   if(scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND && alignment <= HOST_POOL_ALIGNMENT)
+   {
+      size_t class_size = HOST_POOL_MIN_SIZE;
+      for(u32 size_class = 0; size_class < HOST_POOL_CLASS_COUNT; ++size_class)
+      {
+         if(size <= class_size)
+         {
+            result = size_class;
+            break;
+         }
+         class_size *= 2;
+      }
+   }
+
+   return(result);
+}
+
+static void record_host_allocation(u32 scope, s64 size)
+{
+   host_allocation_scope_stats *stats = host_stats.scopes + scope;
+   if(size > 0)
+   {
+      __atomic_fetch_add(&stats->live_count, 1, __ATOMIC_RELAXED);
+      __atomic_fetch_add(&stats->total_count, 1, __ATOMIC_RELAXED);
+      u64 live_bytes = __atomic_add_fetch(&stats->live_bytes, (u64)size, __ATOMIC_RELAXED);
+
+      u64 peak_bytes = __atomic_load_n(&stats->peak_bytes, __ATOMIC_RELAXED);
+      while(live_bytes > peak_bytes &&
+            !__atomic_compare_exchange_n(&stats->peak_bytes, &peak_bytes, live_bytes, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+   }
+   else
+   {
+      __atomic_fetch_sub(&stats->live_count, 1, __ATOMIC_RELAXED);
+      __atomic_fetch_sub(&stats->live_bytes, (u64)-size, __ATOMIC_RELAXED);
+   }
+}
+
+static void *VKAPI_CALL host_allocate(void *user_data, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+   (void)user_data;
+   if(size == 0)
+   {
+      return(0);
+   }
+
+   host_allocation_header *header;
+   u32 size_class = get_host_pool_class(size, alignment, scope);
+   if(size_class != HOST_POOL_NONE)
+   {
+      void **free_list = host_free_lists + size_class;
+      void *block = *free_list;
+      if(block)
+      {
+         *free_list = *(void **)block;
+      }
+      else
+      {
+         block = malloc(sizeof(host_allocation_header) + (HOST_POOL_MIN_SIZE << size_class));
+         if(!block) return(0);
+      }
+
+      header = block;
+      header->block = block;
+      __atomic_fetch_add(&host_stats.pooled_allocations, 1, __ATOMIC_RELAXED);
+   }
+   else
+   {
+      // NOTE: Over-allocate so the header fits in front of a pointer with the
+      // requested alignment.
+      if(alignment < HOST_POOL_ALIGNMENT) alignment = HOST_POOL_ALIGNMENT;
+
+      char *block = malloc(sizeof(host_allocation_header) + alignment + size);
+      if(!block) return(0);
+
+      uintptr_t user = ((uintptr_t)(block + sizeof(host_allocation_header)) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+      header = (host_allocation_header *)user - 1;
+      header->block = block;
+   }
+
+   header->size = size;
+   header->scope = scope;
+   header->size_class = size_class;
+   record_host_allocation(scope, size);
+
+   return(header + 1);
+}
+
+static void VKAPI_CALL host_free(void *user_data, void *memory)
+{
+   (void)user_data;
+   if(!memory)
+   {
+      return;
+   }
+
+   host_allocation_header *header = (host_allocation_header *)memory - 1;
+   record_host_allocation(header->scope, -(s64)header->size);
+
+   if(header->size_class != HOST_POOL_NONE)
+   {
+      // NOTE: Blocks go back to the list of whichever thread frees them, which
+      // is fine since they all came from malloc in the first place.
+      void *block = header->block;
+      *(void **)block = host_free_lists[header->size_class];
+      host_free_lists[header->size_class] = block;
+   }
+   else
+   {
+      free(header->block);
+   }
+}
+
+static void *VKAPI_CALL host_reallocate(void *user_data, void *original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+   if(!original)
+   {
+      return(host_allocate(user_data, size, alignment, scope));
+   }
+   if(size == 0)
+   {
+      host_free(user_data, original);
+      return(0);
+   }
+
+   host_allocation_header *header = (host_allocation_header *)original - 1;
+   void *result = host_allocate(user_data, size, alignment, header->scope);
+   if(result)
+   {
+      memcpy(result, original, (size < header->size) ? size : header->size);
+      host_free(user_data, original);
+   }
+
+   return(result);
+}
+
+static void VKAPI_CALL host_internal_allocate(void *user_data, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope)
+{
+   (void)user_data;
+   (void)type;
+   __atomic_fetch_add(&host_stats.scopes[scope].internal_bytes, size, __ATOMIC_RELAXED);
+}
+
+static void VKAPI_CALL host_internal_free(void *user_data, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope)
+{
+   (void)user_data;
+   (void)type;
+   __atomic_fetch_sub(&host_stats.scopes[scope].internal_bytes, size, __ATOMIC_RELAXED);
+}
+
+static VkAllocationCallbacks host_allocator = {
+   .pfnAllocation = host_allocate,
+   .pfnReallocation = host_reallocate,
+   .pfnFree = host_free,
+   .pfnInternalAllocation = host_internal_allocate,
+   .pfnInternalFree = host_internal_free,
+};
+
+VkAllocationCallbacks *get_host_allocator(void)
+{
+   return(&host_allocator);
+}
+
+void get_host_allocation_stats(host_allocation_stats *stats)
+{
+   for(u32 scope = 0; scope < HOST_ALLOCATION_SCOPE_COUNT; ++scope)
+   {
+      host_allocation_scope_stats *source = host_stats.scopes + scope;
+      host_allocation_scope_stats *dest = stats->scopes + scope;
+      dest->live_count = __atomic_load_n(&source->live_count, __ATOMIC_RELAXED);
+      dest->live_bytes = __atomic_load_n(&source->live_bytes, __ATOMIC_RELAXED);
+      dest->peak_bytes = __atomic_load_n(&source->peak_bytes, __ATOMIC_RELAXED);
+      dest->total_count = __atomic_load_n(&source->total_count, __ATOMIC_RELAXED);
+      dest->internal_bytes = __atomic_load_n(&source->internal_bytes, __ATOMIC_RELAXED);
+   }
+   stats->pooled_allocations = __atomic_load_n(&host_stats.pooled_allocations, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "vk.h"
+
+// NOTE: Allocation callbacks handed to the driver (and VMA and ImGui) so its
+// host memory shows up in our statistics. Every allocation carries a small
+// header recording its size and scope. Small command-scope allocations, which
+// churn every frame as command buffers are recorded and reset, are served
+// from per-thread free lists instead of malloc.
+VkAllocationCallbacks *get_host_allocator(void);
+void get_host_allocation_stats(host_allocation_stats *stats);
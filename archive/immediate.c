@@ -0,0 +1,37 @@
+#include "immediate.h"
+
+void immediate_prepare(vulkan_context *vk)
+{
+   VkCommandBuffer cmd = vk->immediate_command_buffer;
+
+   VK_CHECK(vkResetFences(vk->device, 1, &vk->immediate_fence));
+   VK_CHECK(vkResetCommandBuffer(cmd, 0));
+
+   VkCommandBufferBeginInfo begin_info = {0};
+   begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+   begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+   VK_CHECK(vkBeginCommandBuffer(cmd, &begin_info));
+}
+
+void immediate_submit(vulkan_context *vk)
+{
+   VkCommandBuffer cmd = vk->immediate_command_buffer;
+
+   VK_CHECK(vkEndCommandBuffer(cmd));
+
+   VkCommandBufferSubmitInfo cmd_info = {0};
+   cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+   cmd_info.commandBuffer = cmd;
+
+   VkSubmitInfo2 submit_info = {0};
+   submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+   submit_info.waitSemaphoreInfoCount = 0;
+   submit_info.pWaitSemaphoreInfos = 0;
+   submit_info.signalSemaphoreInfoCount = 0;
+   submit_info.pSignalSemaphoreInfos = 0;
+   submit_info.commandBufferInfoCount = 1;
+   submit_info.pCommandBufferInfos = &cmd_info;
+
+   VK_CHECK(vkQueueSubmit2(vk->graphics_queue, 1, &submit_info, vk->immediate_fence));
+   VK_CHECK(vkWaitForFences(vk->device, 1, &vk->immediate_fence, 0, UINT64_MAX));
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "vk.h"
+
+// NOTE: Records into the immediate command buffer and submits it on the
+// graphics queue, blocking until the GPU has finished. Only for setup,
+// uploads and measurements, never for per-frame work.
+void immediate_prepare(vulkan_context *vk);
+void immediate_submit(vulkan_context *vk);
@@ -0,0 +1,344 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "jobs.h"
+
+#define MAX_JOB_THREADS 64
+#define JOB_DEQUE_SIZE 4096
+#define JOB_IDLE_SPINS 64
+
+typedef struct {
+   job_function *function;
+   parallel_for_function *range_function;
+   void *data;
+
+   u32 first;
+   u32 last;
+   u32 batch_size;
+
+   job_counter *counter;
+} job;
+
+typedef struct {
+   s64 top;
+   u8 top_padding[64 - sizeof(s64)];
+   s64 bottom;
+   u8 bottom_padding[64 - sizeof(s64)];
+
+   job entries[JOB_DEQUE_SIZE];
+} job_deque;
+
+typedef struct {
+   job_deque deque;
+   u32 random_state;
+} job_thread;
+
+static struct {
+   u32 thread_count;
+   job_thread *threads;
+   pthread_t workers[MAX_JOB_THREADS];
+
+   pthread_mutex_t mutex;
+   pthread_cond_t wake;
+   u64 generation;
+   u32 sleeping;
+   b32 quit;
+} jobs;
+
+static __thread u32 job_thread_index;
+
+// NOTE: Chase-Lev deque, following the C11 formulation from Le, Pop, Cohen and
+// Zappa Nardelli, "Correct and Efficient Work-Stealing for Weak Memory Models".
+// The deque has a fixed size rather than growing, and stores jobs by value: a
+// slot can't be overwritten until its entry has been taken, and a thief whose
+// CAS fails simply discards what it copied.
+
+static void push_job(job_deque *deque, job *entry)
+{
+   s64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+   s64 top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+   assert(bottom - top < JOB_DEQUE_SIZE);
+
+   deque->entries[bottom & (JOB_DEQUE_SIZE - 1)] = *entry;
+   __atomic_thread_fence(__ATOMIC_RELEASE);
+   __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+}
+
+static b32 pop_job(job_deque *deque, job *entry)
+{
+   s64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+   __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+   s64 top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+   b32 result = 0;
+   if(top <= bottom)
+   {
+      *entry = deque->entries[bottom & (JOB_DEQUE_SIZE - 1)];
+      result = 1;
+      if(top == bottom)
+      {
+         // NOTE: Last entry, so race any thieves for it.
+         if(!__atomic_compare_exchange_n(&deque->top, &top, top + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+         {
+            result = 0;
+         }
+         __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+      }
+   }
+   else
+   {
+      __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+   }
+
+   return(result);
+}
+
+static b32 steal_job(job_deque *deque, job *entry)
+{
+   s64 top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+   s64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+
+   b32 result = 0;
+   if(top < bottom)
+   {
+      *entry = deque->entries[top & (JOB_DEQUE_SIZE - 1)];
+      result = __atomic_compare_exchange_n(&deque->top, &top, top + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+   }
+
+   return(result);
+}
+
+static b32 find_job(job *entry)
+{
+   job_thread *thread = jobs.threads + job_thread_index;
+
+   b32 result = pop_job(&thread->deque, entry);
+   if(!result && jobs.thread_count > 1)
+   {
+      // NOTE: Start at a random victim so thieves don't all pile onto the same
+      // deque.
+      u32 x = thread->random_state;
+      x ^= x << 13;
+      x ^= x >> 17;
+      x ^= x << 5;
+      thread->random_state = x;
+
+      for(u32 attempt = 0; attempt < jobs.thread_count && !result; ++attempt)
+      {
+         u32 victim = (x + attempt) % jobs.thread_count;
+         if(victim != job_thread_index)
+         {
+            result = steal_job(&jobs.threads[victim].deque, entry);
+         }
+      }
+   }
+
+   return(result);
+}
+
+static void submit_job(job *entry)
+{
+   if(entry->counter)
+   {
+      __atomic_fetch_add(&entry->counter->pending, 1, __ATOMIC_RELAXED);
+   }
+   push_job(&jobs.threads[job_thread_index].deque, entry);
+
+   // NOTE: Pairs with the sleeping/generation check in job_worker: either the
+   // worker sees the new generation and stays awake, or this sees the sleeper
+   // and wakes it.
+   __atomic_fetch_add(&jobs.generation, 1, __ATOMIC_SEQ_CST);
+   if(__atomic_load_n(&jobs.sleeping, __ATOMIC_SEQ_CST) > 0)
+   {
+      pthread_mutex_lock(&jobs.mutex);
+      pthread_cond_broadcast(&jobs.wake);
+      pthread_mutex_unlock(&jobs.mutex);
+   }
+}
+
+static void execute_job(job *entry)
+{
+   if(entry->range_function)
+   {
+      // NOTE: Split the range in half until it is down to a single batch,
+      // leaving the upper halves for other threads to steal.
+      u32 first = entry->first;
+      u32 last = entry->last;
+      while(last - first > entry->batch_size)
+      {
+         u32 batch_count = (last - first + entry->batch_size - 1) / entry->batch_size;
+         u32 middle = first + (batch_count / 2)*entry->batch_size;
+
+         job child = *entry;
+         child.first = middle;
+         child.last = last;
+         submit_job(&child);
+
+         last = middle;
+      }
+
+      entry->range_function(entry->data, first, last);
+   }
+   else
+   {
+      entry->function(entry->data);
+   }
+
+   if(entry->counter)
+   {
+      __atomic_fetch_sub(&entry->counter->pending, 1, __ATOMIC_RELEASE);
+   }
+}
+
+static void *job_worker(void *parameter)
+{
+   job_thread_index = (u32)(memory_index)parameter;
+
+   u32 idle_count = 0;
+   while(!__atomic_load_n(&jobs.quit, __ATOMIC_ACQUIRE))
+   {
+      u64 seen_generation = __atomic_load_n(&jobs.generation, __ATOMIC_SEQ_CST);
+
+      job entry;
+      if(find_job(&entry))
+      {
+         execute_job(&entry);
+         idle_count = 0;
+      }
+      else if(++idle_count < JOB_IDLE_SPINS)
+      {
+         sched_yield();
+      }
+      else
+      {
+         pthread_mutex_lock(&jobs.mutex);
+         __atomic_fetch_add(&jobs.sleeping, 1, __ATOMIC_SEQ_CST);
+         while(!jobs.quit && __atomic_load_n(&jobs.generation, __ATOMIC_SEQ_CST) == seen_generation)
+         {
+            pthread_cond_wait(&jobs.wake, &jobs.mutex);
+         }
+         __atomic_fetch_sub(&jobs.sleeping, 1, __ATOMIC_SEQ_CST);
+         pthread_mutex_unlock(&jobs.mutex);
+
+         idle_count = 0;
+      }
+   }
+
+   return(0);
+}
+
+void initialize_jobs(u32 thread_count)
+{
+   if(thread_count == 0)
+   {
+      long core_count = sysconf(_SC_NPROCESSORS_ONLN);
+      thread_count = (core_count > 0) ? (u32)core_count : 1;
+   }
+   if(thread_count > MAX_JOB_THREADS)
+   {
+      thread_count = MAX_JOB_THREADS;
+   }
+
+   pthread_mutex_init(&jobs.mutex, 0);
+   pthread_cond_init(&jobs.wake, 0);
+
+   jobs.thread_count = thread_count;
+   jobs.threads = calloc(thread_count, sizeof(job_thread));
+   for(u32 thread_index = 0; thread_index < thread_count; ++thread_index)
+   {
+      jobs.threads[thread_index].random_state = 0x9E3779B9u * (thread_index + 1);
+   }
+
+   // NOTE: The calling thread is thread zero and participates whenever it
+   // waits on a counter.
+   job_thread_index = 0;
+   for(u32 thread_index = 1; thread_index < thread_count; ++thread_index)
+   {
+      pthread_create(jobs.workers + thread_index, 0, job_worker, (void *)(memory_index)thread_index);
+   }
+}
+
+void deinitialize_jobs(void)
+{
+   pthread_mutex_lock(&jobs.mutex);
+   __atomic_store_n(&jobs.quit, 1, __ATOMIC_RELEASE);
+   pthread_cond_broadcast(&jobs.wake);
+   pthread_mutex_unlock(&jobs.mutex);
+
+   for(u32 thread_index = 1; thread_index < jobs.thread_count; ++thread_index)
+   {
+      pthread_join(jobs.workers[thread_index], 0);
+   }
+
+   pthread_cond_destroy(&jobs.wake);
+   pthread_mutex_destroy(&jobs.mutex);
+   free(jobs.threads);
+   memset(&jobs, 0, sizeof(jobs));
+}
+
+u32 get_job_thread_count(void)
+{
+   return(jobs.thread_count);
+}
+
+void run_job(job_counter *counter, job_function *function, void *data)
+{
+   if(jobs.thread_count <= 1)
+   {
+      function(data);
+      return;
+   }
+
+   job entry = {0};
+   entry.function = function;
+   entry.data = data;
+   entry.counter = counter;
+   submit_job(&entry);
+}
+
+void wait_for_counter(job_counter *counter)
+{
+   while(__atomic_load_n(&counter->pending, __ATOMIC_ACQUIRE) > 0)
+   {
+      job entry;
+      if(find_job(&entry))
+      {
+         execute_job(&entry);
+      }
+      else
+      {
+         sched_yield();
+      }
+   }
+}
+
+void parallel_for(u32 count, u32 batch_size, parallel_for_function *function, void *data)
+{
+   assert(batch_size > 0);
+
+   if(count <= batch_size || jobs.thread_count <= 1)
+   {
+      if(count > 0) function(data, 0, count);
+      return;
+   }
+
+   job_counter counter = {0};
+
+   job entry = {0};
+   entry.range_function = function;
+   entry.data = data;
+   entry.first = 0;
+   entry.last = count;
+   entry.batch_size = batch_size;
+   entry.counter = &counter;
+
+   // NOTE: The root range runs on this thread directly; its children are
+   // pushed for the workers to steal.
+   counter.pending = 1;
+   execute_job(&entry);
+   wait_for_counter(&counter);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "vk.h"
+
+// NOTE: Every thread that runs jobs (the main thread plus the workers) owns a
+// Chase-Lev deque. Jobs are pushed to and popped from the bottom of the owning
+// thread's deque and idle threads steal from the top of the others.
+
+// NOTE: A counter tracks how many jobs are still outstanding. Waiting on it
+// runs other jobs instead of blocking, so a job may spawn children against its
+// own counter and wait for them without tying up its thread.
+typedef struct {
+   u32 pending;
+} job_counter;
+
+typedef void job_function(void *data);
+
+// NOTE: The callback processes the half-open index range [first, last).
+typedef void parallel_for_function(void *data, u32 first, u32 last);
+
+// NOTE: The thread count includes the main thread. Zero uses one thread per
+// logical core.
+void initialize_jobs(u32 thread_count);
+void deinitialize_jobs(void);
+u32 get_job_thread_count(void);
+
+void run_job(job_counter *counter, job_function *function, void *data);
+void wait_for_counter(job_counter *counter);
+
+void parallel_for(u32 count, u32 batch_size, parallel_for_function *function, void *data);
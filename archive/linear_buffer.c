@@ -0,0 +1,84 @@
+#include "linear_buffer.h"
+#include "memory_budget.h"
+
+void initialize_linear_buffer(linear_buffer *linear, VkPhysicalDevice gpu, VkDevice device, VmaAllocator allocator, VkDeviceSize size)
+{
+   memset(linear, 0, sizeof(*linear));
+
+   // NOTE: Align every allocation so it can also be bound as a uniform or
+   // storage buffer range with a dynamic offset.
+   VkPhysicalDeviceProperties properties;
+   vkGetPhysicalDeviceProperties(gpu, &properties);
+
+   linear->alignment = 16;
+   if(properties.limits.minUniformBufferOffsetAlignment > linear->alignment)
+   {
+      linear->alignment = properties.limits.minUniformBufferOffsetAlignment;
+   }
+   if(properties.limits.minStorageBufferOffsetAlignment > linear->alignment)
+   {
+      linear->alignment = properties.limits.minStorageBufferOffsetAlignment;
+   }
+
+   VkBufferCreateInfo buffer_info = {0};
+   buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+   buffer_info.size = size;
+   buffer_info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT|VK_BUFFER_USAGE_STORAGE_BUFFER_BIT|VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+   buffer_info.usage |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+   VmaAllocationCreateInfo allocation_info = {0};
+   allocation_info.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+   allocation_info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+   VmaAllocationInfo allocation_result;
+   VK_CHECK(vmaCreateBuffer(allocator, &buffer_info, &allocation_info, &linear->buffer, &linear->allocation, &allocation_result));
+   track_memory_allocation(allocator, linear->allocation, MEMORY_SUBSYSTEM_FRAME_CONSTANTS);
+
+   linear->memory = allocation_result.pMappedData;
+   linear->size = size;
+
+   VkBufferDeviceAddressInfo address_info = {0};
+   address_info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+   address_info.buffer = linear->buffer;
+   linear->address = vkGetBufferDeviceAddress(device, &address_info);
+}
+
+void deinitialize_linear_buffer(linear_buffer *linear, VmaAllocator allocator)
+{
+   untrack_memory_allocation(allocator, linear->allocation, MEMORY_SUBSYSTEM_FRAME_CONSTANTS);
+   vmaDestroyBuffer(allocator, linear->buffer, linear->allocation);
+   memset(linear, 0, sizeof(*linear));
+}
+
+void reset_linear_buffer(linear_buffer *linear)
+{
+   if(linear->used > linear->peak)
+   {
+      linear->peak = linear->used;
+   }
+   linear->used = 0;
+}
+
+linear_allocation push_linear_buffer_aligned(linear_buffer *linear, VkDeviceSize size, VkDeviceSize alignment)
+{
+   assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+   VkDeviceSize offset = (linear->used + alignment - 1) & ~(alignment - 1);
+   assert(offset + size <= linear->size);
+
+   linear->used = offset + size;
+
+   linear_allocation result = {0};
+   result.memory = linear->memory + offset;
+   result.address = linear->address + offset;
+   result.buffer = linear->buffer;
+   result.offset = offset;
+
+   return(result);
+}
+
+linear_allocation push_linear_buffer(linear_buffer *linear, VkDeviceSize size)
+{
+   linear_allocation result = push_linear_buffer_aligned(linear, size, linear->alignment);
+   return(result);
+}
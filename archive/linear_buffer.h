@@ -0,0 +1,15 @@
+#pragma once
+
+#include "vk.h"
+
+// NOTE: A persistently mapped buffer that per-frame data is bump-allocated
+// from. Allocations hand back both a CPU pointer to write through and a device
+// address (or buffer and offset, for dynamic offsets) to read from. It can
+// also be the source of transfer copies. Resetting is only safe once the
+// frame that used the buffer has retired.
+void initialize_linear_buffer(linear_buffer *linear, VkPhysicalDevice gpu, VkDevice device, VmaAllocator allocator, VkDeviceSize size);
+void deinitialize_linear_buffer(linear_buffer *linear, VmaAllocator allocator);
+void reset_linear_buffer(linear_buffer *linear);
+
+linear_allocation push_linear_buffer_aligned(linear_buffer *linear, VkDeviceSize size, VkDeviceSize alignment);
+linear_allocation push_linear_buffer(linear_buffer *linear, VkDeviceSize size);
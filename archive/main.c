@@ -1,29 +1,33 @@
 #include "vk.h"
 #include "window_creation.h"
-
-static void load_shader_module(VkShaderModule *result, VkDevice device, memory_arena arena, char *path)
-{
-   FILE *shader_file = fopen(path, "rb");
-   assert(shader_file);
-
-   fseek(shader_file, 0, SEEK_END);
-   size_t shader_file_size = ftell(shader_file);
-   fseek(shader_file, 0, SEEK_SET);
-
-   memory_index count = shader_file_size / sizeof(u32);
-   u32 *shader_code = allocate(&arena, count, u32);
-   assert(shader_code);
-
-   fread(shader_code, shader_file_size, 1, shader_file);
-   fclose(shader_file);
-
-   VkShaderModuleCreateInfo shader_module_info = {0};
-   shader_module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-   shader_module_info.codeSize = shader_file_size;
-   shader_module_info.pCode = shader_code;
-
-   VK_CHECK(vkCreateShaderModule(device, &shader_module_info, 0, result));
-}
+#include "benchmark.h"
+#include "bindless.h"
+#include "command_recorder.h"
+#include "compute_effects.h"
+#include "compute_kernels.h"
+#include "culling.h"
+#include "defragmenter.h"
+#include "descriptor_allocator.h"
+#include "dynamic_resolution.h"
+#include "draw_list.h"
+#include "host_allocator.h"
+#include "immediate.h"
+#include "jobs.h"
+#include "linear_buffer.h"
+#include "memory_budget.h"
+#include "scene.h"
+#include "shaders.h"
+#include "workgroup_tuner.h"
+
+#define MAX_SCENE_NODES (128*1024)
+#define MAX_RENDER_OBJECTS 4096
+#define MIN_DRAWS_PER_SLICE 64
+#define FRAME_CONSTANTS_SIZE (16*1024*1024)
+#define MESH_UPLOAD_BUDGET (4*1024*1024)
+#define RESIDENCY_HIGH_WATERMARK 0.85f
+#define RESIDENCY_LOW_WATERMARK 0.7f
+#define PERMANENT_ARENA_RESERVE (1024LL*1024*1024)
+#define SCRATCH_ARENA_RESERVE (256LL*1024*1024)
 
 static void transition_image(VkCommandBuffer cmd, VkImage image, VkImageLayout old_layout, VkImageLayout new_layout)
 {
@@ -54,36 +58,19 @@ static void transition_image(VkCommandBuffer cmd, VkImage image, VkImageLayout o
    vkCmdPipelineBarrier2(cmd, &dependency_info);
 }
 
-static void copy_image(VkCommandBuffer cmd, VkImage src, VkImage dst, VkExtent2D src_size, VkExtent2D dst_size)
+static b32 has_device_extension(VkExtensionProperties *extensions, u32 extension_count, const char *name)
 {
-   VkImageBlit2 blit_region = {0};
-   blit_region.sType = VK_STRUCTURE_TYPE_IMAGE_BLIT_2;
-   blit_region.srcOffsets[1].x = src_size.width;
-   blit_region.srcOffsets[1].y = src_size.height;
-   blit_region.srcOffsets[1].z = 1;
-   blit_region.dstOffsets[1].x = dst_size.width;
-   blit_region.dstOffsets[1].y = dst_size.height;
-   blit_region.dstOffsets[1].z = 1;
-   blit_region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-   blit_region.srcSubresource.baseArrayLayer = 0;
-   blit_region.srcSubresource.layerCount = 1;
-   blit_region.srcSubresource.mipLevel = 0;
-   blit_region.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-   blit_region.dstSubresource.baseArrayLayer = 0;
-   blit_region.dstSubresource.layerCount = 1;
-   blit_region.dstSubresource.mipLevel = 0;
-
-   VkBlitImageInfo2 blit_info = {0};
-   blit_info.sType = VK_STRUCTURE_TYPE_BLIT_IMAGE_INFO_2;
-   blit_info.dstImage = dst;
-   blit_info.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-   blit_info.srcImage = src;
-   blit_info.srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-   blit_info.filter = VK_FILTER_LINEAR;
-   blit_info.regionCount = 1;
-   blit_info.pRegions = &blit_region;
-
-   vkCmdBlitImage2(cmd, &blit_info);
+   b32 result = 0;
+   for(u32 extension_index = 0; extension_index < extension_count; ++extension_index)
+   {
+      if(strcmp(extensions[extension_index].extensionName, name) == 0)
+      {
+         result = 1;
+         break;
+      }
+   }
+
+   return(result);
 }
 
 static void initialize_pipeline_config(vulkan_pipeline_configuration *config)
@@ -93,6 +80,7 @@ static void initialize_pipeline_config(vulkan_pipeline_configuration *config)
    config->color_blend_attachment = (VkPipelineColorBlendAttachmentState){0};
    config->multisampling          = (VkPipelineMultisampleStateCreateInfo){.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO};
    config->layout                 = (VkPipelineLayout){0};
+   config->flags                  = 0;
    config->depth_stencil          = (VkPipelineDepthStencilStateCreateInfo){.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO};
    config->rendering_info         = (VkPipelineRenderingCreateInfo){.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO};
 
@@ -133,6 +121,7 @@ static VkPipeline create_pipeline(vulkan_pipeline_configuration *config, VkDevic
    pipeline_info.pColorBlendState = &color_blending;
    pipeline_info.pDepthStencilState = &config->depth_stencil;
    pipeline_info.layout = config->layout;
+   pipeline_info.flags = config->flags;
 
    VkDynamicState dynamic_states[] = {
       VK_DYNAMIC_STATE_VIEWPORT,
@@ -146,29 +135,480 @@ static VkPipeline create_pipeline(vulkan_pipeline_configuration *config, VkDevic
    pipeline_info.pDynamicState = &dynamic_info;
 
    VkPipeline result;
-   VK_CHECK(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, 0, &result));
+   VK_CHECK(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, get_host_allocator(), &result));
 
    return(result);
 }
 
-static void draw_background(vulkan_context *vk, VkDescriptorSet *descriptor_set, VkCommandBuffer cmd)
+static void create_render_target(vulkan_context *vk, vulkan_image *target, VkImageUsageFlags usage)
+{
+   VkImageCreateInfo image_create_info = {0};
+   image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+   image_create_info.imageType = VK_IMAGE_TYPE_2D;
+   image_create_info.format = target->format;
+   image_create_info.extent = target->extent;
+   image_create_info.mipLevels = 1;
+   image_create_info.arrayLayers = 1;
+   image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+   image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+   image_create_info.usage = usage;
+
+   VmaAllocationCreateInfo image_alloc_info = {0};
+   image_alloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+   image_alloc_info.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+   VK_CHECK(vmaCreateImage(vk->allocator, &image_create_info, &image_alloc_info, &target->image, &target->allocation, 0));
+   track_memory_allocation(vk->allocator, target->allocation, MEMORY_SUBSYSTEM_RENDER_TARGETS);
+
+   VkImageViewCreateInfo image_view_info = {0};
+   image_view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+   image_view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+   image_view_info.image = target->image;
+   image_view_info.format = target->format;
+   image_view_info.subresourceRange.levelCount = 1;
+   image_view_info.subresourceRange.layerCount = 1;
+   image_view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+
+   VK_CHECK(vkCreateImageView(vk->device, &image_view_info, get_host_allocator(), &target->view));
+}
+
+static void destroy_render_target(vulkan_context *vk, vulkan_image *target)
+{
+   vkDestroyImageView(vk->device, target->view, get_host_allocator());
+   untrack_memory_allocation(vk->allocator, target->allocation, MEMORY_SUBSYSTEM_RENDER_TARGETS);
+   vmaDestroyImage(vk->allocator, target->image, target->allocation);
+}
+
+static void draw_background(vulkan_context *vk, command_recorder *recorder, vulkan_frame_commands *frame)
+{
+   VkCommandBuffer cmd = recorder->cmd;
+
+   // NOTE: The active effect is followed by every enabled overlay. To compare
+   // costs every other effect can also be run and timed first, so the chain
+   // is still what ends up on screen.
+   compute_effect_registry *registry = &vk->effects;
+   build_effect_chain(registry);
+   b32 fuse_chain = can_fuse_effect_chain(registry);
+   u32 chain_divisor = get_effect_chain_divisor(registry);
+
+   u32 effect_order[MAX_COMPUTE_EFFECTS + 2];
+   u32 effect_divisors[MAX_COMPUTE_EFFECTS + 2];
+   u32 effect_count = 0;
+   if(registry->time_all_effects)
+   {
+      for(u32 effect_index = 0; effect_index < registry->effect_count; ++effect_index)
+      {
+         compute_effect *effect = registry->effects + effect_index;
+         if(effect_index != registry->active_effect && !(effect->flags & COMPUTE_EFFECT_OVERLAY))
+         {
+            effect_divisors[effect_count] = effect->resolution_divisor;
+            effect_order[effect_count++] = effect_index;
+         }
+      }
+   }
+   if(fuse_chain)
+   {
+      effect_divisors[effect_count] = chain_divisor;
+      effect_order[effect_count++] = FUSED_EFFECT_CHAIN;
+   }
+   else
+   {
+      for(u32 chain_index = 0; chain_index < registry->chain_length; ++chain_index)
+      {
+         effect_divisors[effect_count] = chain_divisor;
+         effect_order[effect_count++] = registry->chain[chain_index];
+      }
+   }
+
+   // NOTE: Below full resolution the chain draws into the background image,
+   // which is then stretched over the draw extent.
+   if(chain_divisor > 1)
+   {
+      effect_divisors[effect_count] = 1;
+      effect_order[effect_count++] = UPSAMPLED_BACKGROUND;
+   }
+
+   b32 uses_background_image = 0;
+   for(u32 order_index = 0; order_index < effect_count; ++order_index)
+   {
+      if(effect_divisors[order_index] > 1)
+      {
+         uses_background_image = 1;
+      }
+   }
+   if(uses_background_image)
+   {
+      transition_image(cmd, vk->background_image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+   }
+
+   // NOTE: The clear is only needed when the chain's first effect leaves
+   // texels untouched. A fused chain always starts with one that covers the
+   // extent.
+   if(!fuse_chain && !(registry->effects[registry->chain[0]].flags & COMPUTE_EFFECT_COVERS_EXTENT))
+   {
+      VkImage chain_image = (chain_divisor > 1) ? vk->background_image.image : vk->draw_image.image;
+
+      VkImageSubresourceRange clear_range = {0};
+      clear_range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      clear_range.levelCount = VK_REMAINING_MIP_LEVELS;
+      clear_range.layerCount = VK_REMAINING_ARRAY_LAYERS;
+
+      VkClearColorValue color = {{0, 0, 1, 1}};
+      vkCmdClearColorImage(cmd, chain_image, VK_IMAGE_LAYOUT_GENERAL, &color, 1, &clear_range);
+      transition_image(cmd, chain_image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL);
+   }
+
+   frame->timed_effect_count = 0;
+   for(u32 order_index = 0; order_index < effect_count; ++order_index)
+   {
+      u32 effect_index = effect_order[order_index];
+      compute_effect *effect = get_timed_compute_effect(registry, effect_index);
+
+      u32 divisor = effect_divisors[order_index];
+      VkExtent2D extent = get_compute_effect_extent(vk->draw_extent, divisor);
+      vulkan_image *target = (divisor > 1) ? &vk->background_image : &vk->draw_image;
+      u32 target_index = (divisor > 1) ? vk->background_image_index : vk->draw_image_index;
+
+      if(order_index > 0)
+      {
+         transition_image(cmd, target->image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL);
+      }
+
+      u32 query = 2 + 2*frame->timed_effect_count;
+      if(vk->timestamps_supported)
+      {
+         vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, frame->timestamps, query);
+      }
+
+      if(effect_index == FUSED_EFFECT_CHAIN)
+      {
+         // NOTE: Four stages of parameters do not fit in push constants, so
+         // they go through the frame's constant buffer instead.
+         prepare_effect_chain(registry, vk->device, vk->scratch_arena);
+
+         VkDeviceSize stage_size = sizeof(registry->effects[0].constants.data);
+         linear_allocation parameters = push_linear_buffer(&frame->constants, registry->chain_length*stage_size);
+         for(u32 chain_index = 0; chain_index < registry->chain_length; ++chain_index)
+         {
+            compute_effect *stage = registry->effects + registry->chain[chain_index];
+            memcpy((u8 *)parameters.memory + chain_index*stage_size, stage->constants.data, stage_size);
+         }
+
+         effect_chain_push_constants constants = {0};
+         constants.parameters = parameters.address;
+         constants.image_index = target_index;
+         constants.extent_width = extent.width;
+         constants.extent_height = extent.height;
+
+         record_bind_pipeline(recorder, VK_PIPELINE_BIND_POINT_COMPUTE, effect->pipeline);
+         bind_bindless_descriptors(recorder, &vk->bindless, VK_PIPELINE_BIND_POINT_COMPUTE);
+         push_bindless_constants(recorder, &vk->bindless, sizeof(constants), &constants);
+      }
+      else if(effect_index == UPSAMPLED_BACKGROUND)
+      {
+         // NOTE: The draw image barrier above orders this after anything that
+         // was timed into it. This one makes the chain's output visible and
+         // moves it to the layout its sampled descriptor was written with.
+         // Nothing writes it again this frame, and the next frame starts it
+         // from undefined.
+         transition_image(cmd, vk->background_image.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+         prepare_compute_effect(registry, vk->device, vk->scratch_arena, effect);
+
+         VkExtent2D source = get_compute_effect_extent(vk->draw_extent, chain_divisor);
+
+         upscale_push_constants constants = {0};
+         constants.source_step_x = (float)source.width / (float)vk->background_image.extent.width;
+         constants.source_step_y = (float)source.height / (float)vk->background_image.extent.height;
+         constants.source_index = vk->background_image_sampled_index;
+         constants.sampler_index = vk->linear_sampler_index;
+         constants.target_index = target_index;
+         constants.source_width = source.width;
+         constants.source_height = source.height;
+         constants.target_width = extent.width;
+         constants.target_height = extent.height;
+
+         record_bind_pipeline(recorder, VK_PIPELINE_BIND_POINT_COMPUTE, effect->pipeline);
+         bind_bindless_descriptors(recorder, &vk->bindless, VK_PIPELINE_BIND_POINT_COMPUTE);
+         push_bindless_constants(recorder, &vk->bindless, sizeof(constants), &constants);
+      }
+      else
+      {
+         prepare_compute_effect(registry, vk->device, vk->scratch_arena, effect);
+
+         effect->constants.image_index = target_index;
+         effect->constants.extent_width = extent.width;
+         effect->constants.extent_height = extent.height;
+
+         record_bind_pipeline(recorder, VK_PIPELINE_BIND_POINT_COMPUTE, effect->pipeline);
+         bind_bindless_descriptors(recorder, &vk->bindless, VK_PIPELINE_BIND_POINT_COMPUTE);
+         push_bindless_constants(recorder, &vk->bindless, sizeof(effect->constants), &effect->constants);
+      }
+      dispatch_compute_effect(recorder, effect, extent);
+
+      if(vk->timestamps_supported)
+      {
+         vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, frame->timestamps, query + 1);
+         frame->timed_effects[frame->timed_effect_count++] = effect_index;
+      }
+   }
+}
+
+static b32 is_srgb_format(VkFormat format)
+{
+   b32 result = (format == VK_FORMAT_B8G8R8A8_SRGB ||
+                 format == VK_FORMAT_R8G8B8A8_SRGB ||
+                 format == VK_FORMAT_A8B8G8R8_SRGB_PACK32);
+   return(result);
+}
+
+static b32 should_upscale(vulkan_context *vk)
+{
+   b32 result = (vk->resolve.upscaler == UPSCALER_EASU &&
+                 (vk->draw_extent.width < vk->swapchain_extent.width ||
+                  vk->draw_extent.height < vk->swapchain_extent.height));
+   return(result);
+}
+
+static void draw_upscale(vulkan_context *vk, command_recorder *recorder)
+{
+   upscale_push_constants push_constants = {0};
+   push_constants.source_step_x = (float)vk->draw_extent.width / (float)vk->upscale_image.extent.width;
+   push_constants.source_step_y = (float)vk->draw_extent.height / (float)vk->upscale_image.extent.height;
+   push_constants.source_index = vk->draw_image_sampled_index;
+   push_constants.sampler_index = vk->nearest_sampler_index;
+   push_constants.target_index = vk->upscale_image_index;
+   push_constants.source_width = vk->draw_extent.width;
+   push_constants.source_height = vk->draw_extent.height;
+   push_constants.target_width = vk->upscale_image.extent.width;
+   push_constants.target_height = vk->upscale_image.extent.height;
+
+   record_bind_pipeline(recorder, VK_PIPELINE_BIND_POINT_COMPUTE, vk->upscale_pipeline);
+   bind_bindless_descriptors(recorder, &vk->bindless, VK_PIPELINE_BIND_POINT_COMPUTE);
+   push_bindless_constants(recorder, &vk->bindless, sizeof(push_constants), &push_constants);
+   vkCmdDispatch(recorder->cmd, ceilf(push_constants.target_width/8.0f), ceilf(push_constants.target_height/8.0f), 1);
+}
+
+static void draw_luminance(vulkan_context *vk, command_recorder *recorder, vulkan_frame_commands *frame)
+{
+   VkCommandBuffer cmd = recorder->cmd;
+
+   u32 tiles_x = (vk->draw_extent.width + 15) / 16;
+   u32 tiles_y = (vk->draw_extent.height + 15) / 16;
+   linear_allocation partials = push_linear_buffer(&frame->constants, tiles_x*tiles_y*2*sizeof(float));
+   frame->luminance = push_linear_buffer(&frame->constants, 4*sizeof(float));
+   frame->luminance_written = 1;
+
+   luminance_push_constants push_constants = {0};
+   push_constants.partials = partials.address;
+   push_constants.result = frame->luminance.address;
+   push_constants.source_index = vk->draw_image_sampled_index;
+   push_constants.sampler_index = vk->nearest_sampler_index;
+   push_constants.width = vk->draw_extent.width;
+   push_constants.height = vk->draw_extent.height;
+   push_constants.partial_count = tiles_x*tiles_y;
+   push_constants.mode = LUMINANCE_REDUCE_IMAGE;
+
+   record_bind_pipeline(recorder, VK_PIPELINE_BIND_POINT_COMPUTE, vk->luminance_kernel.pipeline);
+   bind_bindless_descriptors(recorder, &vk->bindless, VK_PIPELINE_BIND_POINT_COMPUTE);
+   push_bindless_constants(recorder, &vk->bindless, sizeof(push_constants), &push_constants);
+   vkCmdDispatch(cmd, tiles_x, tiles_y, 1);
+
+   record_compute_barrier(cmd);
+
+   push_constants.mode = LUMINANCE_REDUCE_PARTIALS;
+   push_bindless_constants(recorder, &vk->bindless, sizeof(push_constants), &push_constants);
+   vkCmdDispatch(cmd, 1, 1, 1);
+
+   // NOTE: The result is read on the CPU once the frame's fence signals.
+   VkMemoryBarrier2 memory_barrier = {0};
+   memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+   memory_barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+   memory_barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+   memory_barrier.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT;
+   memory_barrier.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT;
+
+   VkDependencyInfo dependency_info = {0};
+   dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+   dependency_info.memoryBarrierCount = 1;
+   dependency_info.pMemoryBarriers = &memory_barrier;
+
+   vkCmdPipelineBarrier2(cmd, &dependency_info);
+}
+
+static void draw_resolve(vulkan_context *vk, command_recorder *recorder, VkImageView target, b32 upscaled)
+{
+   VkCommandBuffer cmd = recorder->cmd;
+
+   // NOTE: Every pixel is overwritten, so the previous contents don't matter.
+   VkRenderingAttachmentInfo color_attachment_info = {0};
+   color_attachment_info.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+   color_attachment_info.imageView = target;
+   color_attachment_info.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+   color_attachment_info.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+   color_attachment_info.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+
+   VkRenderingInfo rendering_info = {0};
+   rendering_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+   rendering_info.renderArea = (VkRect2D){.extent = vk->swapchain_extent};
+   rendering_info.layerCount = 1;
+   rendering_info.colorAttachmentCount = 1;
+   rendering_info.pColorAttachments = &color_attachment_info;
+
+   vkCmdBeginRendering(cmd, &rendering_info);
+
+   VkViewport viewport = {0};
+   viewport.width = vk->swapchain_extent.width;
+   viewport.height = vk->swapchain_extent.height;
+   viewport.minDepth = 0.0f;
+   viewport.maxDepth = 1.0f;
+   record_set_viewport(recorder, &viewport);
+
+   VkRect2D scissor = {0};
+   scissor.extent = vk->swapchain_extent;
+   record_set_scissor(recorder, &scissor);
+
+   resolve_push_constants push_constants = {0};
+   push_constants.source_scale_x = (float)vk->draw_extent.width / (float)vk->draw_image.extent.width;
+   push_constants.source_scale_y = (float)vk->draw_extent.height / (float)vk->draw_image.extent.height;
+   push_constants.exposure = vk->resolve.exposure;
+   push_constants.tonemapper = vk->resolve.tonemapper;
+   push_constants.source_index = vk->draw_image_sampled_index;
+   push_constants.sampler_index = vk->linear_sampler_index;
+   push_constants.encode_srgb = !is_srgb_format(vk->swapchain_image_format);
+   push_constants.dither = vk->resolve.dither;
+   push_constants.frame_index = (u32)vk->frame_count;
+
+   if(upscaled)
+   {
+      push_constants.source_scale_x = 1.0f;
+      push_constants.source_scale_y = 1.0f;
+      push_constants.source_index = vk->upscale_image_sampled_index;
+      push_constants.sharpen = 1;
+      push_constants.sharpness = exp2f(-vk->resolve.sharpness);
+   }
+
+   record_bind_pipeline(recorder, VK_PIPELINE_BIND_POINT_GRAPHICS, vk->resolve_pipeline);
+   bind_bindless_descriptors(recorder, &vk->bindless, VK_PIPELINE_BIND_POINT_GRAPHICS);
+   push_bindless_constants(recorder, &vk->bindless, sizeof(push_constants), &push_constants);
+   vkCmdDraw(cmd, 3, 1, 0, 0);
+
+   vkCmdEndRendering(cmd);
+}
+
+typedef struct {
+   vulkan_context *vk;
+   vulkan_frame_commands *frame;
+   draw_list *draws;
+   render_object *objects;
+   VkDeviceAddress scene_address;
+   VkDeviceAddress transforms_address;
+
+   u32 slice_count;
+   command_recorder recorders[MAX_RECORDING_SLICES];
+} geometry_recording;
+
+static void record_geometry_slices(void *data, u32 first_slice, u32 last_slice)
 {
-   VkImageSubresourceRange clear_range = {0};
-   clear_range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-   clear_range.levelCount = VK_REMAINING_MIP_LEVELS;
-   clear_range.layerCount = VK_REMAINING_ARRAY_LAYERS;
-
-   VkClearColorValue color = {{0, 0, 1, 1}};
-   vkCmdClearColorImage(cmd, vk->draw_image.image, VK_IMAGE_LAYOUT_GENERAL, &color, 1, &clear_range);
-
-   vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, vk->background_effect.pipeline);
-   vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, vk->background_effect.layout, 0, 1, descriptor_set, 0, 0);
-   vkCmdPushConstants(cmd, vk->background_effect.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(vk->background_effect.constants), &vk->background_effect.constants);
-   vkCmdDispatch(cmd, ceilf(vk->draw_extent.width/16.0f), ceilf(vk->draw_extent.height/16.0f), 1);
+   geometry_recording *recording = data;
+   vulkan_context *vk = recording->vk;
+   vulkan_frame_commands *frame = recording->frame;
+   draw_list *draws = recording->draws;
+
+   for(u32 slice = first_slice; slice < last_slice; ++slice)
+   {
+      // NOTE: Each slice owns its pool for the frame slot, so no two threads
+      // ever touch the same pool.
+      VK_CHECK(vkResetCommandPool(vk->device, frame->slice_pools[slice], 0));
+
+      VkCommandBuffer cmd = frame->slice_commands[slice];
+
+      VkCommandBufferInheritanceRenderingInfo inheritance_rendering_info = {0};
+      inheritance_rendering_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+      inheritance_rendering_info.colorAttachmentCount = 1;
+      inheritance_rendering_info.pColorAttachmentFormats = &vk->draw_image.format;
+      inheritance_rendering_info.depthAttachmentFormat = VK_FORMAT_UNDEFINED;
+      inheritance_rendering_info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+      VkCommandBufferInheritanceInfo inheritance_info = {0};
+      inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+      inheritance_info.pNext = &inheritance_rendering_info;
+
+      VkCommandBufferBeginInfo begin_info = {0};
+      begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+      begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+      begin_info.pInheritanceInfo = &inheritance_info;
+      VK_CHECK(vkBeginCommandBuffer(cmd, &begin_info));
+
+      command_recorder *recorder = recording->recorders + slice;
+      begin_recorder(recorder, cmd);
+
+      // NOTE: Dynamic state is not inherited by secondary command buffers, so
+      // every slice sets its own viewport and scissor.
+      VkViewport viewport = {0};
+      viewport.x = 0;
+      viewport.y = 0;
+      viewport.width = vk->draw_extent.width;
+      viewport.height = vk->draw_extent.height;
+      viewport.minDepth = 0.f;
+      viewport.maxDepth = 1.f;
+
+      record_set_viewport(recorder, &viewport);
+
+      VkRect2D scissor = {0};
+      scissor.offset.x = 0;
+      scissor.offset.y = 0;
+      scissor.extent.width = vk->draw_extent.width;
+      scissor.extent.height = vk->draw_extent.height;
+
+      record_set_scissor(recorder, &scissor);
+
+      // NOTE: Every pipeline shares the bindless layout, so the global set is
+      // bound once per slice and survives pipeline changes.
+      bind_bindless_descriptors(recorder, &vk->bindless, VK_PIPELINE_BIND_POINT_GRAPHICS);
+
+      if(slice == 0)
+      {
+         record_bind_pipeline(recorder, VK_PIPELINE_BIND_POINT_GRAPHICS, vk->triangle_pipeline);
+         vkCmdDraw(cmd, 3, 1, 0, 0);
+      }
+
+      mesh_push_constants push_constants = {0};
+      push_constants.scene_buffer = recording->scene_address;
+      push_constants.transform_buffer = recording->transforms_address;
+
+      // NOTE: The draw list is sorted by state, so consecutive draws mostly share
+      // their pipeline and index buffer, and the recorder drops
+      // the redundant binds.
+      u32 first_draw = (u32)(((u64)draws->count * slice) / recording->slice_count);
+      u32 last_draw = (u32)(((u64)draws->count * (slice + 1)) / recording->slice_count);
+      for(u32 draw_index = first_draw; draw_index < last_draw; ++draw_index)
+      {
+         draw_item *draw = draws->items + draw_index;
+         render_object *object = recording->objects + draw->object_index;
+         vulkan_material *material = vk->materials + object->material_index;
+         vulkan_pipeline *pipeline = vk->pipelines + material->pipeline_index;
+         vulkan_mesh *mesh = vk->meshes + object->mesh_index;
+         geometry_surface *surface = mesh->surfaces + object->surface_index;
+
+         record_bind_pipeline(recorder, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->pipeline);
+         record_bind_index_buffer(recorder, mesh->indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+
+         push_constants.vertex_buffer = mesh->vertex_address;
+         push_constants.transform_index = draw->transform_index;
+         push_bindless_constants(recorder, &vk->bindless, sizeof(push_constants), &push_constants);
+
+         vkCmdDrawIndexed(cmd, surface->count, 1, surface->start_index, 0, 0);
+      }
+
+      VK_CHECK(vkEndCommandBuffer(cmd));
+   }
 }
 
-static void draw_geometry(vulkan_context *vk, VkCommandBuffer cmd, VkDeviceAddress vertex_buffer_address, VkBuffer index_buffer)
+static void draw_geometry(vulkan_context *vk, command_recorder *recorder, vulkan_frame_commands *frame, draw_list *draws, render_object *objects,
+                          VkDeviceAddress scene_address, VkDeviceAddress transforms_address)
 {
+   VkCommandBuffer cmd = recorder->cmd;
+
    VkRenderingAttachmentInfo color_attachment_info = {0};
    color_attachment_info.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
    color_attachment_info.imageView = vk->draw_image.view;
@@ -182,6 +622,7 @@ static void draw_geometry(vulkan_context *vk, VkCommandBuffer cmd, VkDeviceAddre
 
    VkRenderingInfo rendering_info = {0};
    rendering_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+   rendering_info.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
    rendering_info.renderArea = (VkRect2D){.extent = vk->draw_extent};
    rendering_info.layerCount = 1;
    rendering_info.viewMask = 0;
@@ -190,163 +631,548 @@ static void draw_geometry(vulkan_context *vk, VkCommandBuffer cmd, VkDeviceAddre
    rendering_info.pDepthAttachment = 0;
    rendering_info.pStencilAttachment = 0;
 
+   // NOTE: Split the sorted draw list into contiguous slices, record each one
+   // into a secondary command buffer in parallel, then execute them in order.
+   geometry_recording recording = {0};
+   recording.vk = vk;
+   recording.frame = frame;
+   recording.draws = draws;
+   recording.objects = objects;
+   recording.scene_address = scene_address;
+   recording.transforms_address = transforms_address;
+   recording.slice_count = (draws->count + MIN_DRAWS_PER_SLICE - 1) / MIN_DRAWS_PER_SLICE;
+   if(recording.slice_count < 1) recording.slice_count = 1;
+   if(recording.slice_count > vk->recording_slice_count) recording.slice_count = vk->recording_slice_count;
+
+   parallel_for(recording.slice_count, 1, record_geometry_slices, &recording);
+
+   for(u32 slice = 0; slice < recording.slice_count; ++slice)
+   {
+      add_recorder_stats(&recorder->stats, &recording.recorders[slice].stats);
+   }
+
    vkCmdBeginRendering(cmd, &rendering_info);
-   vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, vk->triangle_pipeline);
+   vkCmdExecuteCommands(cmd, recording.slice_count, frame->slice_commands);
+   vkCmdEndRendering(cmd);
 
-   VkViewport viewport = {0};
-   viewport.x = 0;
-   viewport.y = 0;
-   viewport.width = vk->draw_extent.width;
-   viewport.height = vk->draw_extent.height;
-   viewport.minDepth = 0.f;
-   viewport.maxDepth = 1.f;
+   // NOTE: Executing secondaries leaves the primary's bound state undefined.
+   invalidate_recorder_state(recorder);
+}
 
-   vkCmdSetViewport(cmd, 0, 1, &viewport);
+static VkResult try_create_buffer(VmaAllocator allocator, VmaPool pool, memory_index size, VkBufferUsageFlags buffer_usage, VmaMemoryUsage memory_usage,
+                                  memory_subsystem subsystem, vulkan_buffer *result)
+{
+   VkBufferCreateInfo buffer_info = {0};
+   buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+   buffer_info.size = size;
+   buffer_info.usage = buffer_usage;
 
-   VkRect2D scissor = {0};
-   scissor.offset.x = 0;
-   scissor.offset.y = 0;
-   scissor.extent.width = vk->draw_extent.width;
-   scissor.extent.height = vk->draw_extent.height;
+   VmaAllocationCreateInfo alloc_info = {0};
+   alloc_info.usage = memory_usage;
+   alloc_info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+   alloc_info.pool = pool;
 
-   vkCmdSetScissor(cmd, 0, 1, &scissor);
+   memset(result, 0, sizeof(*result));
+   VkResult status = vmaCreateBuffer(allocator, &buffer_info, &alloc_info, &result->buffer, &result->allocation, &result->info);
+   if(status == VK_SUCCESS)
+   {
+      result->subsystem = subsystem;
+      result->size = size;
+      result->usage = buffer_usage;
+      track_memory_allocation(allocator, result->allocation, subsystem);
+   }
 
-   vkCmdDraw(cmd, 3, 1, 0, 0);
+   return(status);
+}
 
-   vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, vk->mesh_pipeline);
+static vulkan_buffer create_buffer(VmaAllocator allocator, memory_index size, VkBufferUsageFlags buffer_usage, VmaMemoryUsage memory_usage, memory_subsystem subsystem)
+{
+   vulkan_buffer result;
+   VK_CHECK(try_create_buffer(allocator, 0, size, buffer_usage, memory_usage, subsystem, &result));
 
-   mesh_push_constants push_constants = {0};
-   push_constants.world_matrix = (mat4){
-      {1, 0, 0, 0},
-      {0, 1, 0, 0},
-      {0, 0, 1, 0},
-      {0, 0, 0, 1},
-   };
-   push_constants.vertex_buffer = vertex_buffer_address;
+   return(result);
+}
 
-   vkCmdPushConstants(cmd, vk->mesh_pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(push_constants), &push_constants);
-   vkCmdBindIndexBuffer(cmd, index_buffer, 0, VK_INDEX_TYPE_UINT32);
+static void destroy_buffer(VmaAllocator allocator, vulkan_buffer *buffer)
+{
+   untrack_memory_allocation(allocator, buffer->allocation, buffer->subsystem);
+   vmaDestroyBuffer(allocator, buffer->buffer, buffer->allocation);
+   memset(buffer, 0, sizeof(*buffer));
+}
 
-   vkCmdDrawIndexed(cmd, 6, 1, 0, 0, 0);
+#define WORKGROUP_TUNING_ROUNDS 5
+#define WORKGROUP_TUNING_DISPATCHES 16
 
-   vkCmdEndRendering(cmd);
+static void tune_compute_effect(vulkan_context *vk, compute_effect *effect, VkPhysicalDeviceProperties *properties)
+{
+   workgroup_size candidates[MAX_WORKGROUP_CANDIDATES];
+   u32 candidate_count = get_workgroup_candidates(&properties->limits, candidates, countof(candidates));
+
+   VkQueryPoolCreateInfo query_pool_info = {0};
+   query_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+   query_pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+   query_pool_info.queryCount = 2;
+
+   VkQueryPool timestamps;
+   VK_CHECK(vkCreateQueryPool(vk->device, &query_pool_info, get_host_allocator(), &timestamps));
+
+   // NOTE: Every candidate fills the whole draw image, the worst case the
+   // effect sees at runtime.
+   VkExtent2D extent = {vk->draw_image.extent.width, vk->draw_image.extent.height};
+   effect->constants.image_index = vk->draw_image_index;
+   effect->constants.extent_width = extent.width;
+   effect->constants.extent_height = extent.height;
+
+   workgroup_size best_size = effect->workgroup;
+   float best_ms = INFINITY;
+
+   // NOTE: Candidate pipelines are built outside the registry's cache, which
+   // only ever gets the winner.
+   compute_effect_registry *registry = &vk->effects;
+   VkShaderModule module = get_compute_effect_module(registry, vk->device, vk->scratch_arena, effect->shader_name);
+   for(u32 candidate_index = 0; candidate_index < candidate_count; ++candidate_index)
+   {
+      effect->workgroup = candidates[candidate_index];
+      effect_specialization specialization = {0};
+      specialization.workgroup = effect->workgroup;
+      VkPipeline candidate_pipeline = create_compute_effect_pipeline(registry, vk->device, module, &specialization);
+
+      // NOTE: The fastest of several rounds is kept, since the first ones
+      // also pay for clocks ramping up and caches warming.
+      float candidate_ms = INFINITY;
+      for(u32 round = 0; round < WORKGROUP_TUNING_ROUNDS; ++round)
+      {
+         immediate_prepare(vk);
+         VkCommandBuffer cmd = vk->immediate_command_buffer;
+
+         transition_image(cmd, vk->draw_image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+         vkCmdResetQueryPool(cmd, timestamps, 0, 2);
+
+         command_recorder recorder;
+         begin_recorder(&recorder, cmd);
+         record_bind_pipeline(&recorder, VK_PIPELINE_BIND_POINT_COMPUTE, candidate_pipeline);
+         bind_bindless_descriptors(&recorder, &vk->bindless, VK_PIPELINE_BIND_POINT_COMPUTE);
+         push_bindless_constants(&recorder, &vk->bindless, sizeof(effect->constants), &effect->constants);
+
+         vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, timestamps, 0);
+         for(u32 dispatch = 0; dispatch < WORKGROUP_TUNING_DISPATCHES; ++dispatch)
+         {
+            // NOTE: Dispatches are serialized as they would be in a frame,
+            // which overlays that read the image also depend on.
+            if(dispatch > 0)
+            {
+               record_compute_barrier(cmd);
+            }
+            dispatch_compute_effect(&recorder, effect, extent);
+         }
+         vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, timestamps, 1);
+
+         immediate_submit(vk);
+
+         u64 ticks[2];
+         VK_CHECK(vkGetQueryPoolResults(vk->device, timestamps, 0, 2, sizeof(ticks), ticks, sizeof(u64),
+                                        VK_QUERY_RESULT_64_BIT|VK_QUERY_RESULT_WAIT_BIT));
+
+         float round_ms = (float)((ticks[1] - ticks[0]) * (double)vk->timestamp_period / 1000000.0);
+         if(round_ms < candidate_ms)
+         {
+            candidate_ms = round_ms;
+         }
+      }
+
+      printf("%s %ux%u: %.3f ms\n", effect->name, effect->workgroup.x, effect->workgroup.y, candidate_ms/WORKGROUP_TUNING_DISPATCHES);
+      if(candidate_ms < best_ms)
+      {
+         best_ms = candidate_ms;
+         best_size = effect->workgroup;
+      }
+
+      vkDestroyPipeline(vk->device, candidate_pipeline, get_host_allocator());
+   }
+   vkDestroyQueryPool(vk->device, timestamps, get_host_allocator());
+
+   effect->workgroup = best_size;
+   effect->pipeline = 0;
+   save_workgroup_size(WORKGROUP_SIZES_PATH, properties, effect->name, best_size);
+
+   printf("%s: using %ux%u\n", effect->name, best_size.x, best_size.y);
 }
 
-static vulkan_buffer create_buffer(VmaAllocator allocator, memory_index size, VkBufferUsageFlags buffer_usage, VmaMemoryUsage memory_usage)
+static VkDeviceSize get_mesh_size(vulkan_mesh *mesh)
 {
-   VkBufferCreateInfo buffer_info = {0};
-   buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-   buffer_info.size = size;
-   buffer_info.usage = buffer_usage;
+   VkDeviceSize result = mesh->vertex_count*sizeof(vertex) + mesh->index_count*sizeof(u32);
+   return(result);
+}
 
-   VmaAllocationCreateInfo alloc_info = {0};
-   alloc_info.usage = memory_usage;
-   alloc_info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+static void release_mesh_buffers(vulkan_context *vk, vulkan_mesh *mesh)
+{
+   assert(mesh->resident);
+
+   destroy_buffer(vk->allocator, &mesh->indices);
+   destroy_buffer(vk->allocator, &mesh->vertices);
+   mesh->vertex_address = 0;
+   mesh->resident = 0;
 
-   vulkan_buffer result = {0};
-   VK_CHECK(vmaCreateBuffer(allocator, &buffer_info, &alloc_info, &result.buffer, &result.allocation, &result.info));
+   vk->residency.resident_meshes--;
+   vk->residency.resident_bytes -= get_mesh_size(mesh);
+}
+
+static VkDeviceSize evict_meshes(vulkan_context *vk, VkDeviceSize bytes_to_free)
+{
+   // NOTE: Least recently used meshes go first. Anything drawn by a frame that
+   // may still be in flight is off limits, which includes the current one.
+   u64 frames_in_flight = countof(vk->frame_commands);
+
+   VkDeviceSize result = 0;
+   while(result < bytes_to_free)
+   {
+      vulkan_mesh *victim = 0;
+      for(u32 mesh_index = 0; mesh_index < vk->mesh_count; ++mesh_index)
+      {
+         vulkan_mesh *mesh = vk->meshes + mesh_index;
+         if(mesh->resident && mesh->last_used_frame + frames_in_flight <= vk->frame_count)
+         {
+            if(!victim || mesh->last_used_frame < victim->last_used_frame)
+            {
+               victim = mesh;
+            }
+         }
+      }
+
+      if(!victim)
+      {
+         break;
+      }
+
+      result += get_mesh_size(victim);
+      release_mesh_buffers(vk, victim);
+      vk->residency.evictions++;
+   }
 
    return(result);
 }
 
-static void immediate_prepare(vulkan_context *vk)
+static b32 allocate_mesh_buffers(vulkan_context *vk, vulkan_mesh *mesh)
 {
-   VkCommandBuffer cmd = vk->immediate_command_buffer;
+   assert(!mesh->resident);
 
-   VK_CHECK(vkResetFences(vk->device, 1, &vk->immediate_fence));
-   VK_CHECK(vkResetCommandBuffer(cmd, 0));
+   VkBufferUsageFlags vertex_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+   VkBufferUsageFlags index_usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+   memory_index vertex_buffer_size = mesh->vertex_count * sizeof(vertex);
+   memory_index index_buffer_size = mesh->index_count * sizeof(u32);
 
-   VkCommandBufferBeginInfo begin_info = {0};
-   begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-   begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-   VK_CHECK(vkBeginCommandBuffer(cmd, &begin_info));
+   // NOTE: Running out of device memory is not fatal. Make room by evicting and
+   // try once more, and failing that leave the mesh evicted so it is simply
+   // not drawn.
+   for(int attempt = 0; attempt < 2; ++attempt)
+   {
+      if(try_create_buffer(vk->allocator, vk->defragmenter.pool, vertex_buffer_size, vertex_usage, VMA_MEMORY_USAGE_GPU_ONLY, MEMORY_SUBSYSTEM_MESHES, &mesh->vertices) == VK_SUCCESS)
+      {
+         if(try_create_buffer(vk->allocator, vk->defragmenter.pool, index_buffer_size, index_usage, VMA_MEMORY_USAGE_GPU_ONLY, MEMORY_SUBSYSTEM_MESHES, &mesh->indices) == VK_SUCCESS)
+         {
+            VkBufferDeviceAddressInfo device_address_info = {0};
+            device_address_info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+            device_address_info.buffer = mesh->vertices.buffer;
+            mesh->vertex_address = vkGetBufferDeviceAddress(vk->device, &device_address_info);
+            mesh->resident = 1;
+
+            // NOTE: Lets the defragmenter find the owner of an allocation it
+            // wants to move.
+            vmaSetAllocationUserData(vk->allocator, mesh->vertices.allocation, mesh);
+            vmaSetAllocationUserData(vk->allocator, mesh->indices.allocation, mesh);
+
+            vk->residency.resident_meshes++;
+            vk->residency.resident_bytes += get_mesh_size(mesh);
+
+            return(1);
+         }
+         destroy_buffer(vk->allocator, &mesh->vertices);
+      }
+
+      vk->residency.failed_allocations++;
+      if(evict_meshes(vk, get_mesh_size(mesh)) == 0)
+      {
+         break;
+      }
+   }
+
+   return(0);
 }
 
-static void immediate_submit(vulkan_context *vk)
+static void record_mesh_copies(VkCommandBuffer cmd, VkBuffer source, VkDeviceSize source_offset, vulkan_mesh *mesh)
 {
-   VkCommandBuffer cmd = vk->immediate_command_buffer;
+   memory_index vertex_buffer_size = mesh->vertex_count * sizeof(vertex);
+   memory_index index_buffer_size = mesh->index_count * sizeof(u32);
+
+   VkBufferCopy vertex_copy = {0};
+   vertex_copy.dstOffset = 0;
+   vertex_copy.srcOffset = source_offset;
+   vertex_copy.size = vertex_buffer_size;
+
+   vkCmdCopyBuffer(cmd, source, mesh->vertices.buffer, 1, &vertex_copy);
+
+   VkBufferCopy index_copy = {0};
+   index_copy.dstOffset = 0;
+   index_copy.srcOffset = source_offset + vertex_buffer_size;
+   index_copy.size = index_buffer_size;
+
+   vkCmdCopyBuffer(cmd, source, mesh->indices.buffer, 1, &index_copy);
+}
+
+typedef struct {
+   u32 mesh_index;
+   linear_allocation staging;
+} mesh_upload;
+
+static b32 stream_mesh(vulkan_context *vk, linear_buffer *staging, vulkan_mesh *mesh, linear_allocation *upload)
+{
+   // NOTE: Re-uploads are staged through the frame's constant buffer and
+   // recorded into the frame's own command buffer, so the frame loop never
+   // waits on them. The per-frame budget spreads a burst of newly visible
+   // meshes over several frames. A mesh larger than the whole budget is let
+   // through as the frame's first upload, otherwise it could never return.
+   VkDeviceSize size = get_mesh_size(mesh);
+   b32 over_budget = (vk->residency.uploaded_bytes + size > vk->residency.upload_budget);
+   if((over_budget && vk->residency.uploaded_bytes > 0) ||
+      staging->used + size + staging->alignment > staging->size)
+   {
+      return(0);
+   }
+
+   if(!allocate_mesh_buffers(vk, mesh))
+   {
+      return(0);
+   }
+
+   *upload = push_linear_buffer(staging, size);
+   memcpy(upload->memory, mesh->cpu_vertices, mesh->vertex_count*sizeof(vertex));
+   memcpy((u8 *)upload->memory + mesh->vertex_count*sizeof(vertex), mesh->cpu_indices, mesh->index_count*sizeof(u32));
+
+   vk->residency.uploads++;
+   vk->residency.uploaded_bytes += size;
+
+   return(1);
+}
+
+static void record_mesh_uploads(vulkan_context *vk, VkCommandBuffer cmd, mesh_upload *uploads, u32 upload_count)
+{
+   if(upload_count > 0)
+   {
+      for(u32 upload_index = 0; upload_index < upload_count; ++upload_index)
+      {
+         mesh_upload *upload = uploads + upload_index;
+         record_mesh_copies(cmd, upload->staging.buffer, upload->staging.offset, vk->meshes + upload->mesh_index);
+      }
 
-   VK_CHECK(vkEndCommandBuffer(cmd));
+      VkMemoryBarrier2 memory_barrier = {0};
+      memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+      memory_barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+      memory_barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+      memory_barrier.dstStageMask = VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT;
+      memory_barrier.dstAccessMask = VK_ACCESS_2_INDEX_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
 
-   VkCommandBufferSubmitInfo cmd_info = {0};
-   cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
-   cmd_info.commandBuffer = cmd;
+      // NOTE: The defragmentation pass recorded next may copy out of a mesh
+      // that was just streamed in.
+      memory_barrier.dstStageMask |= VK_PIPELINE_STAGE_2_COPY_BIT;
+      memory_barrier.dstAccessMask |= VK_ACCESS_2_TRANSFER_READ_BIT;
 
-   VkSubmitInfo2 submit_info = {0};
-   submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
-   submit_info.waitSemaphoreInfoCount = 0;
-   submit_info.pWaitSemaphoreInfos = 0;
-   submit_info.signalSemaphoreInfoCount = 0;
-   submit_info.pSignalSemaphoreInfos = 0;
-   submit_info.commandBufferInfoCount = 1;
-   submit_info.pCommandBufferInfos = &cmd_info;
+      VkDependencyInfo dependency_info = {0};
+      dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+      dependency_info.memoryBarrierCount = 1;
+      dependency_info.pMemoryBarriers = &memory_barrier;
 
-   VK_CHECK(vkQueueSubmit2(vk->graphics_queue, 1, &submit_info, vk->immediate_fence));
-   VK_CHECK(vkWaitForFences(vk->device, 1, &vk->immediate_fence, 0, UINT64_MAX));
+      vkCmdPipelineBarrier2(cmd, &dependency_info);
+   }
 }
 
-static vulkan_mesh push_mesh(vulkan_context *vk, vertex *vertices, int vertex_count, u32 *indices, int index_count)
+static u32 push_mesh(vulkan_context *vk, memory_arena *arena, vertex *vertices, int vertex_count, u32 *indices, int index_count)
 {
-   vulkan_mesh result = {0};
-
-   memory_index vertex_buffer_size = vertex_count * sizeof(*vertices);
-   memory_index index_buffer_size = index_count * sizeof(*indices);
+   assert(vk->mesh_count < countof(vk->meshes));
+
+   u32 result_index = vk->mesh_count++;
+   vulkan_mesh *mesh = vk->meshes + result_index;
+   memset(mesh, 0, sizeof(*mesh));
+
+   mesh->surface_count = 1;
+   mesh->surfaces = allocate(arena, mesh->surface_count, geometry_surface);
+   mesh->surfaces[0].start_index = 0;
+   mesh->surfaces[0].count = index_count;
+
+   mesh->vertex_count = vertex_count;
+   mesh->index_count = index_count;
+   mesh->cpu_vertices = allocate(arena, vertex_count, vertex);
+   mesh->cpu_indices = allocate(arena, index_count, u32);
+   memcpy(mesh->cpu_vertices, vertices, vertex_count*sizeof(*vertices));
+   memcpy(mesh->cpu_indices, indices, index_count*sizeof(*indices));
+   mesh->last_used_frame = vk->frame_count;
+
+   if(vertex_count > 0)
+   {
+      vec3 min = vertices[0].position;
+      vec3 max = vertices[0].position;
+      for(int vertex_index = 1; vertex_index < vertex_count; ++vertex_index)
+      {
+         vec3 p = vertices[vertex_index].position;
+         min.x = fminf(min.x, p.x); max.x = fmaxf(max.x, p.x);
+         min.y = fminf(min.y, p.y); max.y = fmaxf(max.y, p.y);
+         min.z = fminf(min.z, p.z); max.z = fmaxf(max.z, p.z);
+      }
+      mesh->bounds_center = (vec3){0.5f*(min.x + max.x), 0.5f*(min.y + max.y), 0.5f*(min.z + max.z)};
+      mesh->bounds_extent = (vec3){0.5f*(max.x - min.x), 0.5f*(max.y - min.y), 0.5f*(max.z - min.z)};
+   }
 
-   result.vertices = create_buffer(vk->allocator, vertex_buffer_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
-   result.indices = create_buffer(vk->allocator, index_buffer_size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+   // NOTE: A mesh that doesn't fit at load time starts out evicted and is
+   // streamed in once it is visible and there is room.
+   if(allocate_mesh_buffers(vk, mesh))
+   {
+      vulkan_buffer staging_buffer = create_buffer(vk->allocator, get_mesh_size(mesh), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, MEMORY_SUBSYSTEM_STAGING);
+      VmaAllocationInfo staging_allocation_info;
+      vmaGetAllocationInfo(vk->allocator, staging_buffer.allocation, &staging_allocation_info);
 
-   VkBufferDeviceAddressInfo device_address_info = {0};
-   device_address_info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
-   device_address_info.buffer = result.vertices.buffer;
+      void *staging_data = staging_allocation_info.pMappedData;
+      memcpy(staging_data, vertices, vertex_count*sizeof(*vertices));
+      memcpy((char *)staging_data + vertex_count*sizeof(*vertices), indices, index_count*sizeof(*indices));
 
-   result.vertex_address = vkGetBufferDeviceAddress(vk->device, &device_address_info);
+      immediate_prepare(vk);
+      record_mesh_copies(vk->immediate_command_buffer, staging_buffer.buffer, 0, mesh);
+      immediate_submit(vk);
 
-   vulkan_buffer staging_buffer = create_buffer(vk->allocator, vertex_buffer_size + index_buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
-   VmaAllocationInfo staging_allocation_info;
-   vmaGetAllocationInfo(vk->allocator, staging_buffer.allocation, &staging_allocation_info);
+      destroy_buffer(vk->allocator, &staging_buffer);
+   }
 
-   void *staging_data = staging_allocation_info.pMappedData;
-   memcpy(staging_data, vertices, vertex_buffer_size);
-   memcpy((char *)staging_data + vertex_buffer_size, indices, index_buffer_size);
+   return(result_index);
+}
 
-   immediate_prepare(vk);
+typedef struct {
+   char *name;
+   VkFormat format;
+   b32 extended_storage_format;
+   char *shader_suffix;
+} draw_image_format;
+
+// NOTE: Candidate formats for the draw image, preferred first. The packed
+// float format halves render target bandwidth but has no alpha or sign bit.
+static draw_image_format draw_image_formats[] = {
+   {"rgba16f", VK_FORMAT_R16G16B16A16_SFLOAT, 0, ""},
+   {"r11g11b10f", VK_FORMAT_B10G11R11_UFLOAT_PACK32, 1, ".r11g11b10f"},
+};
+
+static b32 is_draw_image_format_supported(VkPhysicalDevice gpu, VkPhysicalDeviceFeatures *features, draw_image_format *candidate)
+{
+   // NOTE: The draw image is cleared, written by compute, rendered to and then
+   // filtered by the resolve, so every one of those has to be supported with
+   // optimal tiling.
+   VkFormatFeatureFlags required = (VK_FORMAT_FEATURE_TRANSFER_DST_BIT |
+                                    VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT |
+                                    VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT |
+                                    VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT |
+                                    VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT);
+
+   VkFormatProperties properties;
+   vkGetPhysicalDeviceFormatProperties(gpu, candidate->format, &properties);
+
+   b32 result = ((properties.optimalTilingFeatures & required) == required);
+   if(candidate->extended_storage_format && !features->shaderStorageImageExtendedFormats)
    {
-      VkCommandBuffer cmd = vk->immediate_command_buffer;
-
-      VkBufferCopy vertex_copy = {0};
-      vertex_copy.dstOffset = 0;
-      vertex_copy.srcOffset = 0;
-      vertex_copy.size = vertex_buffer_size;
+      result = 0;
+   }
 
-      vkCmdCopyBuffer(cmd, staging_buffer.buffer, result.vertices.buffer, 1, &vertex_copy);
+   return(result);
+}
 
-      VkBufferCopy index_copy = {0};
-      index_copy.dstOffset = 0;
-      index_copy.srcOffset = vertex_buffer_size;
-      index_copy.size = index_buffer_size;
+static draw_image_format *select_draw_image_format(VkPhysicalDevice gpu, char *requested_name)
+{
+   VkPhysicalDeviceFeatures features;
+   vkGetPhysicalDeviceFeatures(gpu, &features);
 
-      vkCmdCopyBuffer(cmd, staging_buffer.buffer, result.indices.buffer, 1, &index_copy);
+   draw_image_format *result = 0;
+   for(u32 format_index = 0; format_index < countof(draw_image_formats); ++format_index)
+   {
+      draw_image_format *candidate = draw_image_formats + format_index;
+      if(strcmp(candidate->name, requested_name) == 0)
+      {
+         if(is_draw_image_format_supported(gpu, &features, candidate))
+         {
+            result = candidate;
+         }
+         else
+         {
+            fprintf(stderr, "Draw image format %s is not supported, falling back.\n", candidate->name);
+         }
+         break;
+      }
    }
-   immediate_submit(vk);
-
-   vmaDestroyBuffer(vk->allocator, staging_buffer.buffer, staging_buffer.allocation);
 
+   for(u32 format_index = 0; !result && format_index < countof(draw_image_formats); ++format_index)
+   {
+      draw_image_format *candidate = draw_image_formats + format_index;
+      if(is_draw_image_format_supported(gpu, &features, candidate))
+      {
+         result = candidate;
+      }
+   }
 
+   if(!result)
+   {
+      fprintf(stderr, "No supported draw image format.\n");
+      exit(1);
+   }
 
    return(result);
 }
 
-int main(void)
+static void load_draw_image_shader(VkShaderModule *result, VkDevice device, memory_arena *arena, draw_image_format *format, char *name)
+{
+   char path[128];
+   snprintf(path, sizeof(path), "%s%s.comp.spv", name, format->shader_suffix);
+   load_shader_module(result, device, arena, path);
+}
+
+int main(int argument_count, char **arguments)
 {
-   memory_index arena_size = 1024*1024;
-   memory_arena arena = {0};
-   arena.begin = malloc(arena_size);
-   arena.end = arena.begin + arena_size;
+   b32 benchmark_mode = 0;
+   b32 request_descriptor_buffer = 0;
+   b32 tune_workgroups = 0;
+   b32 portable_kernels = 0;
+   char *requested_effect = "gradient";
+   char *requested_draw_format = draw_image_formats[0].name;
+   for(int argument_index = 1; argument_index < argument_count; ++argument_index)
+   {
+      char *draw_format_option = "--draw-format=";
+      char *effect_option = "--effect=";
+      if(strcmp(arguments[argument_index], "--benchmark") == 0)
+      {
+         benchmark_mode = 1;
+      }
+      else if(strcmp(arguments[argument_index], "--descriptor-buffer") == 0)
+      {
+         request_descriptor_buffer = 1;
+      }
+      else if(strcmp(arguments[argument_index], "--tune-workgroups") == 0)
+      {
+         tune_workgroups = 1;
+      }
+      else if(strcmp(arguments[argument_index], "--portable-kernels") == 0)
+      {
+         portable_kernels = 1;
+      }
+      else if(strncmp(arguments[argument_index], draw_format_option, strlen(draw_format_option)) == 0)
+      {
+         requested_draw_format = arguments[argument_index] + strlen(draw_format_option);
+      }
+      else if(strncmp(arguments[argument_index], effect_option, strlen(effect_option)) == 0)
+      {
+         requested_effect = arguments[argument_index] + strlen(effect_option);
+      }
+   }
 
-   memory_index scratch_size = 1024*1024;
-   memory_arena scratch = {0};
-   scratch.begin = malloc(scratch_size);
-   scratch.end = scratch.begin + scratch_size;
+   // NOTE: The permanent arena holds everything that lives as long as the
+   // program. The scratch arena is reset at the start of every frame, so
+   // anything transient goes there instead of the heap.
+   memory_arena arena = create_arena(PERMANENT_ARENA_RESERVE);
+   memory_arena scratch = create_arena(SCRATCH_ARENA_RESERVE);
+
+   initialize_jobs(0);
 
    // Enable instance extensions.
    u32 instance_extension_count = 0;
@@ -428,7 +1254,10 @@ int main(void)
    instance_create_info.ppEnabledExtensionNames = required_instance_extensions;
 
    vulkan_context vk = {0};
-   VK_CHECK(vkCreateInstance(&instance_create_info, 0, &vk.instance));
+   vk.permanent_arena = &arena;
+   vk.scratch_arena = &scratch;
+   vk.host_allocator = get_host_allocator();
+   VK_CHECK(vkCreateInstance(&instance_create_info, get_host_allocator(), &vk.instance));
 
    // Get physical GPU.
    uint32_t gpu_count = 0;
@@ -496,6 +1325,47 @@ int main(void)
       }
    }
 
+   // NOTE: Optional extensions are enabled when present, and the features that
+   // depend on them fall back when they aren't.
+   u32 enabled_device_extension_count = 0;
+   const char *enabled_device_extensions[countof(required_device_extensions) + 4];
+   for(int required_index = 0; required_index < countof(required_device_extensions); ++required_index)
+   {
+      enabled_device_extensions[enabled_device_extension_count++] = required_device_extensions[required_index];
+   }
+
+   b32 descriptor_buffer_supported = 0;
+   if(request_descriptor_buffer)
+   {
+      VkPhysicalDeviceDescriptorBufferFeaturesEXT descriptor_buffer_features = {0};
+      descriptor_buffer_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT;
+
+      VkPhysicalDeviceFeatures2 supported_features = {0};
+      supported_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+      supported_features.pNext = &descriptor_buffer_features;
+
+      if(has_device_extension(device_extensions, device_extension_count, VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME))
+      {
+         vkGetPhysicalDeviceFeatures2(vk.gpu, &supported_features);
+         descriptor_buffer_supported = descriptor_buffer_features.descriptorBuffer;
+      }
+
+      if(descriptor_buffer_supported)
+      {
+         enabled_device_extensions[enabled_device_extension_count++] = VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME;
+      }
+      else
+      {
+         fprintf(stderr, "Warning: %s not supported, falling back to descriptor sets.\n", VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME);
+      }
+   }
+
+   b32 memory_budget_supported = has_device_extension(device_extensions, device_extension_count, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+   if(memory_budget_supported)
+   {
+      enabled_device_extensions[enabled_device_extension_count++] = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+   }
+
    // Create window and surface.
    if(!create_window(&vk, "Vulkan Test Program", 400*2, 300*2))
    {
@@ -542,13 +1412,47 @@ int main(void)
    }
    assert(found_all);
 
+   // NOTE: Frame timing needs timestamps on the graphics queue. Without them
+   // the render scale stays fixed at whatever the controller starts with.
+   VkPhysicalDeviceProperties gpu_properties;
+   vkGetPhysicalDeviceProperties(vk.gpu, &gpu_properties);
+
+   vk.timestamps_supported = (queue_families[graphics_queue_index].timestampValidBits > 0 &&
+                              gpu_properties.limits.timestampPeriod > 0.0f);
+   vk.timestamp_period = gpu_properties.limits.timestampPeriod;
+
+   // NOTE: Compute kernels pick their subgroup or portable variant from this
+   // when their pipelines are created. The portable one can be forced to
+   // compare the two or to work around a driver.
+   query_subgroup_capabilities(vk.gpu, &vk.subgroups);
+   vk.subgroups.disabled = portable_kernels;
+
+   draw_image_format *draw_format = select_draw_image_format(vk.gpu, requested_draw_format);
+   vk.draw_image_format_name = draw_format->name;
+
    // Initialize a logical device.
    float queue_priorities[] = {1.0f};
    VkPhysicalDeviceFeatures device_features = {0};
+   device_features.shaderStorageImageExtendedFormats = draw_format->extended_storage_format;
 
    VkPhysicalDeviceVulkan12Features features12 = {0};
    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
    features12.bufferDeviceAddress = VK_TRUE;
+   features12.descriptorIndexing = VK_TRUE;
+   features12.runtimeDescriptorArray = VK_TRUE;
+   features12.descriptorBindingPartiallyBound = VK_TRUE;
+   features12.descriptorBindingStorageImageUpdateAfterBind = VK_TRUE;
+   features12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+   features12.shaderStorageImageArrayNonUniformIndexing = VK_TRUE;
+   features12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+
+   VkPhysicalDeviceDescriptorBufferFeaturesEXT descriptor_buffer_features = {0};
+   descriptor_buffer_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT;
+   descriptor_buffer_features.descriptorBuffer = VK_TRUE;
+   if(descriptor_buffer_supported)
+   {
+      features12.pNext = &descriptor_buffer_features;
+   }
 
    VkPhysicalDeviceVulkan13Features features13 = {0};
    features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
@@ -587,10 +1491,15 @@ int main(void)
    device_create_info.queueCreateInfoCount = queue_create_info_count;
    device_create_info.enabledLayerCount = countof(required_layers);
    device_create_info.ppEnabledLayerNames = required_layers;
-   device_create_info.enabledExtensionCount = countof(required_device_extensions);
-   device_create_info.ppEnabledExtensionNames = required_device_extensions;
+   device_create_info.enabledExtensionCount = enabled_device_extension_count;
+   device_create_info.ppEnabledExtensionNames = enabled_device_extensions;
 
-   VK_CHECK(vkCreateDevice(vk.gpu, &device_create_info, 0, &vk.device));
+   VK_CHECK(vkCreateDevice(vk.gpu, &device_create_info, get_host_allocator(), &vk.device));
+
+   if(descriptor_buffer_supported)
+   {
+      load_recorder_functions(vk.device);
+   }
 
    vkGetDeviceQueue(vk.device, graphics_queue_index, 0, &vk.graphics_queue);
    vkGetDeviceQueue(vk.device, present_queue_index, 0, &vk.present_queue);
@@ -661,7 +1570,7 @@ int main(void)
    swapchain_create_info.imageColorSpace = surface_format.colorSpace;
    swapchain_create_info.imageExtent = vk.swapchain_extent;
    swapchain_create_info.imageArrayLayers = 1;
-   swapchain_create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT|VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+   swapchain_create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
    if(graphics_queue_index != present_queue_index)
    {
       swapchain_create_info.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
@@ -678,7 +1587,7 @@ int main(void)
    swapchain_create_info.clipped = VK_TRUE;
    swapchain_create_info.oldSwapchain = VK_NULL_HANDLE;
 
-   VK_CHECK(vkCreateSwapchainKHR(vk.device, &swapchain_create_info, 0, &vk.swapchain));
+   VK_CHECK(vkCreateSwapchainKHR(vk.device, &swapchain_create_info, get_host_allocator(), &vk.swapchain));
 
    vk.swapchain_image_format = surface_format.format;
 
@@ -704,7 +1613,7 @@ int main(void)
       info.subresourceRange.baseArrayLayer = 0;
       info.subresourceRange.layerCount = 1;
 
-      VK_CHECK(vkCreateImageView(vk.device, &info, 0, &vk.swapchain_image_views[image_index]));
+      VK_CHECK(vkCreateImageView(vk.device, &info, get_host_allocator(), &vk.swapchain_image_views[image_index]));
    }
 
    // Initialize commands.
@@ -715,7 +1624,7 @@ int main(void)
 
    for(int frame_index = 0; frame_index < countof(vk.frame_commands); ++frame_index)
    {
-      vkCreateCommandPool(vk.device, &command_pool_info, 0, &vk.frame_commands[frame_index].pool);
+      vkCreateCommandPool(vk.device, &command_pool_info, get_host_allocator(), &vk.frame_commands[frame_index].pool);
 
       VkCommandBufferAllocateInfo allocate_info = {0};
       allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -725,6 +1634,36 @@ int main(void)
       VK_CHECK(vkAllocateCommandBuffers(vk.device, &allocate_info, &vk.frame_commands[frame_index].commands));
    }
 
+   // NOTE: Geometry is recorded in parallel into secondary command buffers,
+   // one pool per recording slice and frame slot, with as many slices as there
+   // are job threads.
+   vk.recording_slice_count = get_job_thread_count();
+   if(vk.recording_slice_count > MAX_RECORDING_SLICES)
+   {
+      vk.recording_slice_count = MAX_RECORDING_SLICES;
+   }
+
+   VkCommandPoolCreateInfo slice_pool_info = {0};
+   slice_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+   slice_pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+   slice_pool_info.queueFamilyIndex = graphics_queue_index;
+
+   for(int frame_index = 0; frame_index < countof(vk.frame_commands); ++frame_index)
+   {
+      vulkan_frame_commands *frame = vk.frame_commands + frame_index;
+      for(u32 slice = 0; slice < vk.recording_slice_count; ++slice)
+      {
+         VK_CHECK(vkCreateCommandPool(vk.device, &slice_pool_info, get_host_allocator(), &frame->slice_pools[slice]));
+
+         VkCommandBufferAllocateInfo allocate_info = {0};
+         allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+         allocate_info.commandPool = frame->slice_pools[slice];
+         allocate_info.commandBufferCount = 1;
+         allocate_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+         VK_CHECK(vkAllocateCommandBuffers(vk.device, &allocate_info, &frame->slice_commands[slice]));
+      }
+   }
+
    // Initialize synchronization.
    VkFenceCreateInfo fence_info = {0};
    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
@@ -735,10 +1674,24 @@ int main(void)
 
    for(int frame_index = 0; frame_index < countof(vk.frame_commands); ++frame_index)
    {
-      VK_CHECK(vkCreateSemaphore(vk.device, &semaphore_info, 0, &vk.frame_commands[frame_index].swapchain_semaphore));
-      VK_CHECK(vkCreateSemaphore(vk.device, &semaphore_info, 0, &vk.frame_commands[frame_index].render_semaphore));
-      VK_CHECK(vkCreateFence(vk.device, &fence_info, 0, &vk.frame_commands[frame_index].render_fence));
+      VK_CHECK(vkCreateSemaphore(vk.device, &semaphore_info, get_host_allocator(), &vk.frame_commands[frame_index].swapchain_semaphore));
+      VK_CHECK(vkCreateSemaphore(vk.device, &semaphore_info, get_host_allocator(), &vk.frame_commands[frame_index].render_semaphore));
+      VK_CHECK(vkCreateFence(vk.device, &fence_info, get_host_allocator(), &vk.frame_commands[frame_index].render_fence));
+   }
+
+   if(vk.timestamps_supported)
+   {
+      VkQueryPoolCreateInfo query_pool_info = {0};
+      query_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+      query_pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+      query_pool_info.queryCount = FRAME_TIMESTAMP_QUERIES;
+
+      for(int frame_index = 0; frame_index < countof(vk.frame_commands); ++frame_index)
+      {
+         VK_CHECK(vkCreateQueryPool(vk.device, &query_pool_info, get_host_allocator(), &vk.frame_commands[frame_index].timestamps));
+      }
    }
+   initialize_dynamic_resolution(&vk.resolution, 1000.0f/60.0f, 0.5f, 1.0f);
 
    // Initialize allocator.
    VmaAllocatorCreateInfo allocator_info = {0};
@@ -746,161 +1699,180 @@ int main(void)
    allocator_info.device = vk.device;
    allocator_info.instance = vk.instance;
    allocator_info.flags = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
+   if(memory_budget_supported)
+   {
+      allocator_info.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+   }
+   allocator_info.pAllocationCallbacks = vk.host_allocator;
    VK_CHECK(vmaCreateAllocator(&allocator_info, &vk.allocator));
+   vk.memory.budget_extension = memory_budget_supported;
+   update_memory_budget(&vk.memory, vk.allocator);
+
+   vk.residency.high_watermark = RESIDENCY_HIGH_WATERMARK;
+   vk.residency.low_watermark = RESIDENCY_LOW_WATERMARK;
+   vk.residency.upload_budget = MESH_UPLOAD_BUDGET;
+   initialize_defragmenter(&vk.defragmenter, vk.allocator);
+
+   // Initialize per-frame constant buffers.
+   for(int frame_index = 0; frame_index < countof(vk.frame_commands); ++frame_index)
+   {
+      initialize_linear_buffer(&vk.frame_commands[frame_index].constants, vk.gpu, vk.device, vk.allocator, FRAME_CONSTANTS_SIZE);
+   }
 
    // Initialize draw image.
    VkExtent3D draw_image_extent = {vk.swapchain_extent.width, vk.swapchain_extent.height, 1};
-   vk.draw_image.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+   vk.draw_image.format = draw_format->format;
    vk.draw_image.extent = draw_image_extent;
 
    VkImageUsageFlags draw_image_usages = 0;
-   draw_image_usages |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
    draw_image_usages |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
    draw_image_usages |= VK_IMAGE_USAGE_STORAGE_BIT;
    draw_image_usages |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+   draw_image_usages |= VK_IMAGE_USAGE_SAMPLED_BIT;
 
-   VkImageCreateInfo image_create_info = {0};
-   image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-   image_create_info.imageType = VK_IMAGE_TYPE_2D;
-   image_create_info.format = vk.draw_image.format;
-   image_create_info.extent = vk.draw_image.extent;
-   image_create_info.mipLevels = 1;
-   image_create_info.arrayLayers = 1;
-   image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
-   image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
-   image_create_info.usage = draw_image_usages;
+   create_render_target(&vk, &vk.draw_image, draw_image_usages);
 
-   VmaAllocationCreateInfo image_alloc_info = {0};
-   image_alloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-   image_alloc_info.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+   // NOTE: The upscaler writes output-resolution pixels here whenever the draw
+   // extent is below the swapchain's, and the resolve then reads it 1:1.
+   vk.upscale_image.format = vk.draw_image.format;
+   vk.upscale_image.extent = (VkExtent3D){vk.swapchain_extent.width, vk.swapchain_extent.height, 1};
+   create_render_target(&vk, &vk.upscale_image, VK_IMAGE_USAGE_STORAGE_BIT|VK_IMAGE_USAGE_SAMPLED_BIT);
 
-   VK_CHECK(vmaCreateImage(vk.allocator, &image_create_info, &image_alloc_info, &vk.draw_image.image, &vk.draw_image.allocation, 0));
+   // NOTE: Backgrounds drawn below full resolution go here first. Half the
+   // draw image is enough, a quarter just uses the corner of it.
+   vk.background_image.format = vk.draw_image.format;
+   vk.background_image.extent = (VkExtent3D){(draw_image_extent.width + 1)/2, (draw_image_extent.height + 1)/2, 1};
+   create_render_target(&vk, &vk.background_image, VK_IMAGE_USAGE_STORAGE_BIT|VK_IMAGE_USAGE_SAMPLED_BIT|VK_IMAGE_USAGE_TRANSFER_DST_BIT);
 
-   VkImageViewCreateInfo image_view_info = {0};
-   image_view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-   image_view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-   image_view_info.image = vk.draw_image.image;
-   image_view_info.format = vk.draw_image.format;
-   image_view_info.subresourceRange.levelCount = 1;
-   image_view_info.subresourceRange.layerCount = 1;
-   image_view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+   // Initialize descriptors.
+   initialize_bindless_descriptors(&vk.bindless, vk.gpu, vk.device, vk.allocator, descriptor_buffer_supported);
+   vk.draw_image_index = add_bindless_storage_image(&vk.bindless, vk.device, vk.draw_image.view);
+   vk.draw_image_sampled_index = add_bindless_sampled_image(&vk.bindless, vk.device, vk.draw_image.view);
+   vk.upscale_image_index = add_bindless_storage_image(&vk.bindless, vk.device, vk.upscale_image.view);
+   vk.upscale_image_sampled_index = add_bindless_sampled_image(&vk.bindless, vk.device, vk.upscale_image.view);
+   vk.background_image_index = add_bindless_storage_image(&vk.bindless, vk.device, vk.background_image.view);
+   vk.background_image_sampled_index = add_bindless_sampled_image(&vk.bindless, vk.device, vk.background_image.view);
+
+   // NOTE: Long-lived resources go through the bindless set. Anything that
+   // needs a set for a single frame allocates it from that frame slot's
+   // allocator instead.
+   descriptor_pool_ratio frame_descriptor_ratios[] = {
+      {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1},
+      {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 2},
+      {VK_DESCRIPTOR_TYPE_SAMPLER, 1},
+      {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1},
+      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2},
+   };
+   for(int frame_index = 0; frame_index < countof(vk.frame_commands); ++frame_index)
+   {
+      initialize_descriptor_allocator(&vk.frame_commands[frame_index].descriptors, vk.device, 64,
+                                      frame_descriptor_ratios, countof(frame_descriptor_ratios));
+   }
 
-   VK_CHECK(vkCreateImageView(vk.device, &image_view_info, 0, &vk.draw_image.view));
+   VkSamplerCreateInfo sampler_info = {0};
+   sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+   sampler_info.magFilter = VK_FILTER_LINEAR;
+   sampler_info.minFilter = VK_FILTER_LINEAR;
+   sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+   sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+   sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+   sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+   sampler_info.maxLod = VK_LOD_CLAMP_NONE;
+   VK_CHECK(vkCreateSampler(vk.device, &sampler_info, get_host_allocator(), &vk.linear_sampler));
+   vk.linear_sampler_index = add_bindless_sampler(&vk.bindless, vk.device, vk.linear_sampler);
+
+   sampler_info.magFilter = VK_FILTER_NEAREST;
+   sampler_info.minFilter = VK_FILTER_NEAREST;
+   sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+   VK_CHECK(vkCreateSampler(vk.device, &sampler_info, get_host_allocator(), &vk.nearest_sampler));
+   vk.nearest_sampler_index = add_bindless_sampler(&vk.bindless, vk.device, vk.nearest_sampler);
+
+   // Initialize compute effects.
+   initialize_compute_effects(&vk.effects, vk.bindless.pipeline_layout, vk.bindless.pipeline_flags, draw_format->shader_suffix);
+
+   effect_parameter gradient_parameters[] = {
+      {"top", EFFECT_PARAMETER_COLOR, {1, 0, 0, 1}},
+      {"bottom", EFFECT_PARAMETER_COLOR, {0, 0, 1, 1}},
+   };
+   // NOTE: Gradients are smooth enough to draw at a quarter of the extent,
+   // the sky's sun and stars need at least half.
+   compute_effect *gradient = register_compute_effect(&vk.effects, "gradient", "gradient_color", BACKGROUND_EFFECT_GRADIENT, COMPUTE_EFFECT_COVERS_EXTENT,
+                                                      gradient_parameters, countof(gradient_parameters));
+   gradient->resolution_divisor = 4;
+
+   effect_parameter dusk_parameters[] = {
+      {"top", EFFECT_PARAMETER_COLOR, {0.1f, 0.05f, 0.3f, 1}},
+      {"bottom", EFFECT_PARAMETER_COLOR, {1.0f, 0.45f, 0.2f, 1}},
+   };
+   compute_effect *dusk = register_compute_effect(&vk.effects, "dusk", "gradient_color", BACKGROUND_EFFECT_GRADIENT, COMPUTE_EFFECT_COVERS_EXTENT,
+                                                  dusk_parameters, countof(dusk_parameters));
+   dusk->resolution_divisor = 4;
 
-   // Initialize descriptors.
-   VkDescriptorSetLayoutBinding binding = {0};
-   binding.binding = 0;
-   binding.descriptorCount = 1;
-   binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-   binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-
-   VkDescriptorSetLayoutCreateInfo layout_info = {0};
-   layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-   layout_info.pNext = 0;
-   layout_info.pBindings = &binding;
-   layout_info.bindingCount = 1;
-   layout_info.flags = 0;
-
-   VkDescriptorSetLayout layout;
-   VK_CHECK(vkCreateDescriptorSetLayout(vk.device, &layout_info, 0, &layout));
-
-   u32 max_sets = 10;
-   VkDescriptorPoolSize pool_size = {0};
-   pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-   pool_size.descriptorCount = 1 * max_sets;
-
-   VkDescriptorPoolCreateInfo pool_info = {0};
-   pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-   pool_info.maxSets = max_sets;
-   pool_info.poolSizeCount = 1;
-   pool_info.pPoolSizes = &pool_size;
-
-   VkDescriptorPool pool;
-   vkCreateDescriptorPool(vk.device, &pool_info, 0, &pool);
-
-   VkDescriptorSetAllocateInfo allocation_info = {0};
-   allocation_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-   allocation_info.descriptorPool = pool;
-   allocation_info.descriptorSetCount = 1;
-   allocation_info.pSetLayouts = &layout;
-
-   VkDescriptorSet descriptor_set;
-   VK_CHECK(vkAllocateDescriptorSets(vk.device, &allocation_info, &descriptor_set));
-
-   VkDescriptorImageInfo image_info = {0};
-   image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-   image_info.imageView = vk.draw_image.view;
-
-   VkWriteDescriptorSet draw_image_write = {0};
-   draw_image_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-   draw_image_write.dstBinding = 0;
-   draw_image_write.dstSet = descriptor_set;
-   draw_image_write.descriptorCount = 1;
-   draw_image_write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-   draw_image_write.pImageInfo = &image_info;
-
-   vkUpdateDescriptorSets(vk.device, 1, &draw_image_write, 0, 0);
-
-   // Initialize compute pipeline.
-   VkShaderModule compute_shader_module;
-   load_shader_module(&compute_shader_module, vk.device, arena, "gradient_color.comp.spv");
-
-   VkPipelineLayoutCreateInfo compute_layout_info = {0};
-   compute_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-   compute_layout_info.pSetLayouts = &layout;
-   compute_layout_info.setLayoutCount = 1;
-
-   VkPushConstantRange push_constant_range = {0};
-   push_constant_range.offset = 0;
-   push_constant_range.size = sizeof(compute_push_constants);
-   push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-
-   compute_layout_info.pPushConstantRanges = &push_constant_range;
-   compute_layout_info.pushConstantRangeCount = 1;
-
-   VkPipelineLayout compute_pipeline_layout;
-   VK_CHECK(vkCreatePipelineLayout(vk.device, &compute_layout_info, 0, &compute_pipeline_layout));
-
-   VkPipelineShaderStageCreateInfo stage_create_info = {0};
-   stage_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-   stage_create_info.stage = VK_SHADER_STAGE_COMPUTE_BIT;
-   stage_create_info.module = compute_shader_module;
-   stage_create_info.pName = "main";
+   register_compute_effect(&vk.effects, "grid", "gradient", BACKGROUND_EFFECT_GRID, COMPUTE_EFFECT_COVERS_EXTENT, 0, 0);
 
-   VkComputePipelineCreateInfo compute_pipeline_create_info = {0};
-   compute_pipeline_create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-   compute_pipeline_create_info.layout = compute_pipeline_layout;
-   compute_pipeline_create_info.stage = stage_create_info;
+   effect_parameter sky_parameters[] = {
+      {"zenith", EFFECT_PARAMETER_COLOR, {0.1f, 0.3f, 0.8f, 1}},
+      {"horizon", EFFECT_PARAMETER_COLOR, {0.7f, 0.8f, 0.95f, 1}},
+      {"sun (x, y, radius, stars)", EFFECT_PARAMETER_VECTOR, {0.7f, 0.25f, 0.03f, 0}},
+      {"sun color", EFFECT_PARAMETER_COLOR, {8.0f, 7.0f, 5.0f, 1}},
+   };
+   compute_effect *sky = register_compute_effect(&vk.effects, "sky", "sky", BACKGROUND_EFFECT_SKY, COMPUTE_EFFECT_COVERS_EXTENT,
+                                                 sky_parameters, countof(sky_parameters));
+   sky->resolution_divisor = 2;
+
+   effect_parameter vignette_parameters[] = {
+      {"strength, inner, outer", EFFECT_PARAMETER_VECTOR, {0.6f, 0.3f, 0.9f, 0}},
+      {"tint", EFFECT_PARAMETER_COLOR, {0, 0, 0, 1}},
+   };
+   register_compute_effect(&vk.effects, "vignette", "vignette", BACKGROUND_EFFECT_VIGNETTE, COMPUTE_EFFECT_OVERLAY,
+                           vignette_parameters, countof(vignette_parameters));
+
+   for(u32 effect_index = 0; effect_index < vk.effects.effect_count; ++effect_index)
+   {
+      compute_effect *effect = vk.effects.effects + effect_index;
+      if(!load_workgroup_size(WORKGROUP_SIZES_PATH, &gpu_properties, effect->name, &effect->workgroup))
+      {
+         effect->workgroup = (workgroup_size){DEFAULT_WORKGROUP_SIZE_X, DEFAULT_WORKGROUP_SIZE_Y};
+      }
+   }
 
-   compute_effect gradient = {0};
-   gradient.name = "gradient";
-   gradient.layout = compute_pipeline_layout;
-   gradient.constants.data[0] = (vec4){1, 0, 0, 1};
-   gradient.constants.data[1] = (vec4){0, 0, 1, 1};
+   if(!select_compute_effect(&vk.effects, requested_effect))
+   {
+      fprintf(stderr, "Unknown compute effect %s, using %s.\n", requested_effect, vk.effects.effects[0].name);
+   }
 
-   VK_CHECK(vkCreateComputePipelines(vk.device, VK_NULL_HANDLE, 1, &compute_pipeline_create_info, 0, &gradient.pipeline));
+   // Initialize upscale pipeline.
+   VkShaderModule upscale_shader_module;
+   load_draw_image_shader(&upscale_shader_module, vk.device, &scratch, draw_format, "easu");
+
+   VkComputePipelineCreateInfo compute_pipeline_create_info = {0};
+   compute_pipeline_create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+   compute_pipeline_create_info.layout = vk.bindless.pipeline_layout;
+   compute_pipeline_create_info.flags = vk.bindless.pipeline_flags;
+   compute_pipeline_create_info.stage = (VkPipelineShaderStageCreateInfo){
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+      .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+      .module = upscale_shader_module,
+      .pName = "main",
+   };
+   VK_CHECK(vkCreateComputePipelines(vk.device, VK_NULL_HANDLE, 1, &compute_pipeline_create_info, get_host_allocator(), &vk.upscale_pipeline));
 
-   vk.background_effect = gradient;
+   // Initialize compute kernels.
+   create_compute_kernel(&vk.luminance_kernel, vk.device, &scratch, vk.bindless.pipeline_layout, vk.bindless.pipeline_flags, &vk.subgroups,
+                         "luminance", VK_SUBGROUP_FEATURE_BASIC_BIT|VK_SUBGROUP_FEATURE_ARITHMETIC_BIT);
 
    // Initialize triangle pipeline.
    VkShaderModule vertex_shader_module;
-   load_shader_module(&vertex_shader_module, vk.device, arena, "triangle.vert.spv");
+   load_shader_module(&vertex_shader_module, vk.device, &scratch, "triangle.vert.spv");
 
    VkShaderModule fragment_shader_module;
-   load_shader_module(&fragment_shader_module, vk.device, arena, "triangle.frag.spv");
-
-   VkPipelineLayoutCreateInfo triangle_layout_info = {0};
-   triangle_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-   triangle_layout_info.pSetLayouts = &layout;
-   triangle_layout_info.setLayoutCount = 1;
-
-   VkPipelineLayout triangle_pipeline_layout;
-   VK_CHECK(vkCreatePipelineLayout(vk.device, &triangle_layout_info, 0, &triangle_pipeline_layout));
+   load_shader_module(&fragment_shader_module, vk.device, &scratch, "triangle.frag.spv");
 
    vulkan_pipeline_configuration triangle_pipeline_config = {0};
    initialize_pipeline_config(&triangle_pipeline_config);
 
-   triangle_pipeline_config.layout = triangle_pipeline_layout;
+   triangle_pipeline_config.layout = vk.bindless.pipeline_layout;
+   triangle_pipeline_config.flags = vk.bindless.pipeline_flags;
    triangle_pipeline_config.input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
    triangle_pipeline_config.input_assembly.primitiveRestartEnable = VK_FALSE;
 
@@ -951,30 +1923,16 @@ int main(void)
 
    // Initialize mesh pipeline.
    VkShaderModule vertex_mesh_shader_module;
-   load_shader_module(&vertex_mesh_shader_module, vk.device, arena, "triangle_mesh.vert.spv");
+   load_shader_module(&vertex_mesh_shader_module, vk.device, &scratch, "triangle_mesh.vert.spv");
 
    VkShaderModule fragment_mesh_shader_module;
-   load_shader_module(&fragment_mesh_shader_module, vk.device, arena, "triangle_mesh.frag.spv");
-
-   VkPipelineLayoutCreateInfo mesh_layout_info = {0};
-   mesh_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-   mesh_layout_info.pSetLayouts = &layout;
-   mesh_layout_info.setLayoutCount = 1;
-
-   VkPushConstantRange mesh_push_constant_range = {0};
-   mesh_push_constant_range.offset = 0;
-   mesh_push_constant_range.size = sizeof(mesh_push_constants);
-   mesh_push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-
-   mesh_layout_info.pPushConstantRanges = &mesh_push_constant_range;
-   mesh_layout_info.pushConstantRangeCount = 1;
-
-   VK_CHECK(vkCreatePipelineLayout(vk.device, &mesh_layout_info, 0, &vk.mesh_pipeline_layout));
+   load_shader_module(&fragment_mesh_shader_module, vk.device, &scratch, "triangle_mesh.frag.spv");
 
    vulkan_pipeline_configuration mesh_pipeline_config = {0};
    initialize_pipeline_config(&mesh_pipeline_config);
 
-   mesh_pipeline_config.layout = vk.mesh_pipeline_layout;
+   mesh_pipeline_config.layout = vk.bindless.pipeline_layout;
+   mesh_pipeline_config.flags = vk.bindless.pipeline_flags;
    mesh_pipeline_config.input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
    mesh_pipeline_config.input_assembly.primitiveRestartEnable = VK_FALSE;
 
@@ -1023,9 +1981,83 @@ int main(void)
 
    vk.mesh_pipeline = create_pipeline(&mesh_pipeline_config, vk.device);
 
+   u32 mesh_pipeline_index = vk.pipeline_count++;
+   vk.pipelines[mesh_pipeline_index].pipeline = vk.mesh_pipeline;
+   vk.pipelines[mesh_pipeline_index].layout = vk.bindless.pipeline_layout;
+
+   u32 default_material_index = vk.material_count++;
+   vk.materials[default_material_index].pass = RENDER_PASS_OPAQUE;
+   vk.materials[default_material_index].pipeline_index = mesh_pipeline_index;
+
+   // Initialize resolve pipeline.
+   VkShaderModule vertex_resolve_shader_module;
+   load_shader_module(&vertex_resolve_shader_module, vk.device, &scratch, "resolve.vert.spv");
+
+   VkShaderModule fragment_resolve_shader_module;
+   load_shader_module(&fragment_resolve_shader_module, vk.device, &scratch, "resolve.frag.spv");
+
+   vulkan_pipeline_configuration resolve_pipeline_config = {0};
+   initialize_pipeline_config(&resolve_pipeline_config);
+
+   resolve_pipeline_config.layout = vk.bindless.pipeline_layout;
+   resolve_pipeline_config.flags = vk.bindless.pipeline_flags;
+   resolve_pipeline_config.input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+   resolve_pipeline_config.input_assembly.primitiveRestartEnable = VK_FALSE;
+
+   resolve_pipeline_config.rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+   resolve_pipeline_config.rasterizer.lineWidth = 1.0f;
+   resolve_pipeline_config.rasterizer.cullMode = VK_CULL_MODE_NONE;
+   resolve_pipeline_config.rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+
+   resolve_pipeline_config.shader_stages[0] = (VkPipelineShaderStageCreateInfo){
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+      .stage = VK_SHADER_STAGE_VERTEX_BIT,
+      .module = vertex_resolve_shader_module,
+      .pName = "main",
+   };
+   resolve_pipeline_config.shader_stages[1] = (VkPipelineShaderStageCreateInfo){
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+      .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+      .module = fragment_resolve_shader_module,
+      .pName = "main",
+   };
+
+   resolve_pipeline_config.multisampling.sampleShadingEnable = VK_FALSE;
+   resolve_pipeline_config.multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+   resolve_pipeline_config.multisampling.minSampleShading = 1.0f;
+   resolve_pipeline_config.multisampling.pSampleMask = 0;
+   resolve_pipeline_config.multisampling.alphaToCoverageEnable = VK_FALSE;
+   resolve_pipeline_config.multisampling.alphaToOneEnable = VK_FALSE;
+
+   resolve_pipeline_config.color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT|VK_COLOR_COMPONENT_G_BIT|VK_COLOR_COMPONENT_B_BIT|VK_COLOR_COMPONENT_A_BIT;
+   resolve_pipeline_config.color_blend_attachment.blendEnable = VK_FALSE;
+
+   // NOTE: The resolve writes straight into the swapchain image.
+   resolve_pipeline_config.color_attachment_format = vk.swapchain_image_format;
+   resolve_pipeline_config.rendering_info.colorAttachmentCount = 1;
+   resolve_pipeline_config.rendering_info.pColorAttachmentFormats = &resolve_pipeline_config.color_attachment_format;
+
+   resolve_pipeline_config.rendering_info.depthAttachmentFormat = VK_FORMAT_UNDEFINED;
+   resolve_pipeline_config.depth_stencil.depthTestEnable = VK_FALSE;
+   resolve_pipeline_config.depth_stencil.depthWriteEnable = VK_FALSE;
+   resolve_pipeline_config.depth_stencil.depthCompareOp = VK_COMPARE_OP_NEVER;
+   resolve_pipeline_config.depth_stencil.depthBoundsTestEnable = VK_FALSE;
+   resolve_pipeline_config.depth_stencil.stencilTestEnable = VK_FALSE;
+   resolve_pipeline_config.depth_stencil.front = (VkStencilOpState){0};
+   resolve_pipeline_config.depth_stencil.back = (VkStencilOpState){0};
+   resolve_pipeline_config.depth_stencil.minDepthBounds = 0.f;
+   resolve_pipeline_config.depth_stencil.maxDepthBounds = 1.f;
+
+   vk.resolve_pipeline = create_pipeline(&resolve_pipeline_config, vk.device);
+   vk.resolve.exposure = 1.0f;
+   vk.resolve.tonemapper = TONEMAP_ACES;
+   vk.resolve.dither = 1;
+   vk.resolve.upscaler = UPSCALER_EASU;
+   vk.resolve.sharpness = 0.2f;
+
    // Initialize IMGUI.
    VkCommandPool immediate_command_pool;
-   VK_CHECK(vkCreateCommandPool(vk.device, &command_pool_info, 0, &immediate_command_pool));
+   VK_CHECK(vkCreateCommandPool(vk.device, &command_pool_info, get_host_allocator(), &immediate_command_pool));
 
    VkCommandBufferAllocateInfo command_allocate_info = {0};
    command_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -1034,10 +2066,25 @@ int main(void)
    command_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
 
    VK_CHECK(vkAllocateCommandBuffers(vk.device, &command_allocate_info, &vk.immediate_command_buffer));
-   VK_CHECK(vkCreateFence(vk.device, &fence_info, 0, &vk.immediate_fence));
+   VK_CHECK(vkCreateFence(vk.device, &fence_info, get_host_allocator(), &vk.immediate_fence));
 
    initialize_imgui(&vk);
 
+   if(tune_workgroups)
+   {
+      if(vk.timestamps_supported)
+      {
+         for(u32 effect_index = 0; effect_index < vk.effects.effect_count; ++effect_index)
+         {
+            tune_compute_effect(&vk, vk.effects.effects + effect_index, &gpu_properties);
+         }
+      }
+      else
+      {
+         fprintf(stderr, "Workgroup tuning needs GPU timestamps, keeping the current sizes.\n");
+      }
+   }
+
    vertex vertices[4] = {0};
    vertices[0].position = (vec3){0.5, -0.5, 0};
    vertices[1].position = (vec3){0.5, 0.5, 0};
@@ -1057,19 +2104,158 @@ int main(void)
    indices[4] = 1;
    indices[5] = 3;
 
-   vulkan_mesh mesh_buffers = push_mesh(&vk, vertices, countof(vertices), indices, countof(indices));
+   u32 quad_mesh_index = push_mesh(&vk, &arena, vertices, countof(vertices), indices, countof(indices));
+
+   // Initialize scene.
+   scene_transforms scene = {0};
+   initialize_scene_transforms(&scene, &arena, MAX_SCENE_NODES);
+
+   scene_node scene_root = create_scene_node(&scene, SCENE_NO_PARENT);
+   scene_node mesh_node = create_scene_node(&scene, scene_root);
+
+   // Initialize culling.
+   u32 render_object_count = 0;
+   render_object *render_objects = allocate(&arena, MAX_RENDER_OBJECTS, render_object);
+
+   render_object *quad_object = render_objects + render_object_count++;
+   quad_object->mesh_index = quad_mesh_index;
+   quad_object->surface_index = 0;
+   quad_object->material_index = default_material_index;
+   quad_object->scene_node = mesh_node;
+
+   culling_bounds bounds = {0};
+   initialize_culling_bounds(&bounds, &arena, MAX_RENDER_OBJECTS);
+
+   draw_list draws = {0};
+   initialize_draw_list(&draws, &arena, MAX_RENDER_OBJECTS);
+
+   if(benchmark_mode)
+   {
+      run_benchmarks(&vk, "benchmark.json");
+   }
 
    // Render loop.
-   while(!window_should_close(&vk))
+   while(!benchmark_mode && !window_should_close(&vk))
    {
       vulkan_frame_commands *frame = vk.frame_commands + (vk.frame_count % countof(vk.frame_commands));
 
-      vk.draw_extent.width = vk.draw_image.extent.width;
-      vk.draw_extent.height = vk.draw_image.extent.height;
-
       VK_CHECK(vkWaitForFences(vk.device, 1, &frame->render_fence, 1, UINT64_MAX));
       VK_CHECK(vkResetFences(vk.device, 1, &frame->render_fence));
 
+      // NOTE: The timing is from the frame that last used this slot, so the
+      // controller always runs a frame or two behind the scale it measured.
+      if(frame->timestamps_written)
+      {
+         u64 timestamps[FRAME_TIMESTAMP_QUERIES];
+         u32 query_count = 2 + 2*frame->timed_effect_count;
+         VkResult query_result = vkGetQueryPoolResults(vk.device, frame->timestamps, 0, query_count, query_count*sizeof(u64), timestamps,
+                                                       sizeof(u64), VK_QUERY_RESULT_64_BIT);
+         if(query_result == VK_SUCCESS && timestamps[1] > timestamps[0])
+         {
+            float gpu_ms = (float)((timestamps[1] - timestamps[0]) * (double)vk.timestamp_period / 1000000.0);
+            update_dynamic_resolution(&vk.resolution, gpu_ms);
+
+            for(u32 timed_index = 0; timed_index < frame->timed_effect_count; ++timed_index)
+            {
+               u64 *effect_timestamps = timestamps + 2 + 2*timed_index;
+               float effect_ms = (float)((effect_timestamps[1] - effect_timestamps[0]) * (double)vk.timestamp_period / 1000000.0);
+               update_compute_effect_timing(get_timed_compute_effect(&vk.effects, frame->timed_effects[timed_index]), effect_ms, vk.frame_count);
+            }
+         }
+      }
+
+      if(frame->luminance_written)
+      {
+         vmaInvalidateAllocation(vk.allocator, frame->constants.allocation, frame->luminance.offset, 4*sizeof(float));
+         float *luminance = frame->luminance.memory;
+         vk.average_luminance = exp2f(luminance[0]);
+         vk.max_luminance = luminance[1];
+      }
+
+      VkExtent2D full_extent = {vk.draw_image.extent.width, vk.draw_image.extent.height};
+      vk.draw_extent = get_dynamic_resolution_extent(&vk.resolution, full_extent);
+
+      // NOTE: The frame that last used this slot has retired, so its transient
+      // descriptor sets can all be returned at once.
+      reset_descriptor_allocator(&frame->descriptors, vk.device);
+      reset_linear_buffer(&frame->constants);
+      reset_arena(&scratch);
+      retire_defragmentation_pass(&vk);
+
+      update_scene_transforms(&scene);
+
+      // NOTE: Per-frame data is written straight into this slot's mapped
+      // constant buffer and read by shaders through its device address.
+      linear_allocation transforms = push_linear_buffer(&frame->constants, scene.count*sizeof(mat4));
+      memcpy(transforms.memory, scene.world_matrices, scene.count*sizeof(mat4));
+
+      mat4 view_projection = {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1}};
+
+      linear_allocation scene_data = push_linear_buffer(&frame->constants, sizeof(scene_constants));
+      ((scene_constants *)scene_data.memory)->view_projection = view_projection;
+      culling_frustum frustum = extract_culling_frustum(view_projection);
+
+      for(u32 object_index = 0; object_index < render_object_count; ++object_index)
+      {
+         render_object *object = render_objects + object_index;
+         vulkan_mesh *mesh = vk.meshes + object->mesh_index;
+
+         u32 world_index = get_scene_node_world_index(&scene, object->scene_node);
+         set_culling_box(&bounds, object_index, scene.world_matrices[world_index], mesh->bounds_center, mesh->bounds_extent);
+      }
+
+      u32 *visible_objects = allocate(&scratch, bounds.capacity, u32);
+      u32 visible_count = cull_bounds(&bounds, &frustum, visible_objects);
+
+      for(u32 visible_index = 0; visible_index < visible_count; ++visible_index)
+      {
+         render_object *object = render_objects + visible_objects[visible_index];
+         vk.meshes[object->mesh_index].last_used_frame = vk.frame_count;
+      }
+
+      // NOTE: Usage comes from the budget sampled at the end of the last frame.
+      residency_manager *residency = &vk.residency;
+      VkDeviceSize high_watermark = (VkDeviceSize)(residency->high_watermark * vk.memory.device_local_budget);
+      VkDeviceSize low_watermark = (VkDeviceSize)(residency->low_watermark * vk.memory.device_local_budget);
+      if(vk.memory.device_local_budget > 0 && vk.memory.device_local_usage > high_watermark)
+      {
+         evict_meshes(&vk, vk.memory.device_local_usage - low_watermark);
+      }
+
+      residency->uploaded_bytes = 0;
+      residency->deferred_draws = 0;
+      u32 mesh_upload_count = 0;
+      mesh_upload *mesh_uploads = allocate(&scratch, vk.mesh_count, mesh_upload);
+
+      clear_draw_list(&draws);
+      for(u32 visible_index = 0; visible_index < visible_count; ++visible_index)
+      {
+         u32 object_index = visible_objects[visible_index];
+         render_object *object = render_objects + object_index;
+         vulkan_material *material = vk.materials + object->material_index;
+         vulkan_mesh *mesh = vk.meshes + object->mesh_index;
+
+         if(!mesh->resident)
+         {
+            mesh_upload *upload = mesh_uploads + mesh_upload_count;
+            if(!stream_mesh(&vk, &frame->constants, mesh, &upload->staging))
+            {
+               residency->deferred_draws++;
+               continue;
+            }
+            upload->mesh_index = object->mesh_index;
+            mesh_upload_count++;
+         }
+
+         vec4 center = {bounds.center_x[object_index], bounds.center_y[object_index], bounds.center_z[object_index], 1};
+         vec4 clip = mat4_transform(view_projection, center);
+         float depth = (clip.w != 0) ? clip.z/clip.w : 0;
+
+         u64 key = make_draw_key(material->pass, material->pipeline_index, object->material_index, object->mesh_index, depth);
+         push_draw(&draws, key, object_index, get_scene_node_world_index(&scene, object->scene_node));
+      }
+      sort_draw_list(&draws);
+
       u32 swapchain_image_index;
       VK_CHECK(vkAcquireNextImageKHR(vk.device, vk.swapchain, UINT64_MAX, frame->swapchain_semaphore, 0, &swapchain_image_index));
 
@@ -1081,19 +2267,65 @@ int main(void)
       begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
       VK_CHECK(vkBeginCommandBuffer(cmd, &begin_info));
 
+      if(vk.timestamps_supported)
+      {
+         vkCmdResetQueryPool(cmd, frame->timestamps, 0, FRAME_TIMESTAMP_QUERIES);
+      }
+
+      record_mesh_uploads(&vk, cmd, mesh_uploads, mesh_upload_count);
+      run_defragmentation_pass(&vk, cmd);
+
       // Draw background.
       transition_image(cmd, vk.draw_image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
-      draw_background(&vk, &descriptor_set, cmd);
+
+      // NOTE: The frame is timed from here to the swapchain transition. This
+      // barrier covers all commands, so it chains with the wait for the
+      // swapchain image. Starting earlier would count time blocked on the
+      // image, which under FIFO is vsync, as GPU load and drive the render
+      // scale down.
+      if(vk.timestamps_supported)
+      {
+         vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, frame->timestamps, 0);
+      }
+
+      command_recorder recorder;
+      begin_recorder(&recorder, cmd);
+
+      draw_background(&vk, &recorder, frame);
 
       transition_image(cmd, vk.draw_image.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-      draw_geometry(&vk, cmd, mesh_buffers.vertex_address, mesh_buffers.indices.buffer);
-      draw_imgui(&vk, cmd, vk.draw_image.view);
+      draw_geometry(&vk, &recorder, frame, &draws, render_objects, scene_data.address, transforms.address);
+
+      // NOTE: The resolve reads the draw image once and writes the finished
+      // pixels into the swapchain image, and the UI is drawn over that. Below
+      // native resolution the draw image is upscaled first and the resolve
+      // sharpens the upscaled image instead.
+      transition_image(cmd, vk.draw_image.image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+      draw_luminance(&vk, &recorder, frame);
+
+      b32 upscaled = should_upscale(&vk);
+      if(upscaled)
+      {
+         transition_image(cmd, vk.upscale_image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+         draw_upscale(&vk, &recorder);
+         transition_image(cmd, vk.upscale_image.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+      }
+
+      if(vk.timestamps_supported)
+      {
+         vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, frame->timestamps, 1);
+         frame->timestamps_written = 1;
+      }
+
+      transition_image(cmd, vk.swapchain_images[swapchain_image_index], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
 
-      transition_image(cmd, vk.draw_image.image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-      transition_image(cmd, vk.swapchain_images[swapchain_image_index], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-      copy_image(cmd, vk.draw_image.image, vk.swapchain_images[swapchain_image_index], vk.draw_extent, vk.swapchain_extent);
+      draw_resolve(&vk, &recorder, vk.swapchain_image_views[swapchain_image_index], upscaled);
+      draw_imgui(&vk, cmd, vk.swapchain_image_views[swapchain_image_index]);
+      invalidate_recorder_state(&recorder);
+
+      transition_image(cmd, vk.swapchain_images[swapchain_image_index], VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
 
-      transition_image(cmd, vk.swapchain_images[swapchain_image_index], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
       VK_CHECK(vkEndCommandBuffer(cmd));
 
       VkCommandBufferSubmitInfo cmd_info = {0};
@@ -1131,6 +2363,12 @@ int main(void)
 
       VK_CHECK(vkQueuePresentKHR(vk.graphics_queue, &present_info));
 
+      vk.recorder_stats = recorder.stats;
+      vk.descriptor_stats = frame->descriptors.stats;
+      get_host_allocation_stats(&vk.host_stats);
+      update_memory_budget(&vk.memory, vk.allocator);
+      vk.frame_constants_used = frame->constants.used;
+      vk.frame_constants_peak = frame->constants.peak;
       vk.frame_count++;
    };
 
@@ -1138,47 +2376,79 @@ int main(void)
    vkDeviceWaitIdle(vk.device);
 
    deinitialize_imgui(&vk);
-   vkDestroyFence(vk.device, vk.immediate_fence, 0);
-   vkDestroyCommandPool(vk.device, immediate_command_pool, 0);
-
-   vmaDestroyBuffer(vk.allocator, mesh_buffers.indices.buffer, mesh_buffers.indices.allocation);
-   vmaDestroyBuffer(vk.allocator, mesh_buffers.vertices.buffer, mesh_buffers.vertices.allocation);
+   vkDestroyFence(vk.device, vk.immediate_fence, get_host_allocator());
+   vkDestroyCommandPool(vk.device, immediate_command_pool, get_host_allocator());
 
-   vkDestroyShaderModule(vk.device, compute_shader_module, 0);
-   vkDestroyShaderModule(vk.device, vertex_shader_module, 0);
-   vkDestroyShaderModule(vk.device, fragment_shader_module, 0);
-   vkDestroyShaderModule(vk.device, vertex_mesh_shader_module, 0);
-   vkDestroyShaderModule(vk.device, fragment_mesh_shader_module, 0);
-
-   vkDestroyPipelineLayout(vk.device, vk.background_effect.layout, 0);
-   vkDestroyPipelineLayout(vk.device, triangle_pipeline_layout, 0);
-   vkDestroyPipelineLayout(vk.device, vk.mesh_pipeline_layout, 0);
-
-   vkDestroyPipeline(vk.device, vk.background_effect.pipeline, 0);
-   vkDestroyPipeline(vk.device, vk.triangle_pipeline, 0);
-   vkDestroyPipeline(vk.device, vk.mesh_pipeline, 0);
-
-   vkDestroyDescriptorPool(vk.device, pool, 0);
-   vkDestroyDescriptorSetLayout(vk.device, layout, 0);
+   stop_defragmentation(&vk.defragmenter, vk.device, vk.allocator);
+   for(u32 mesh_index = 0; mesh_index < vk.mesh_count; ++mesh_index)
+   {
+      vulkan_mesh *mesh = vk.meshes + mesh_index;
+      if(mesh->resident)
+      {
+         release_mesh_buffers(&vk, mesh);
+      }
+   }
+   deinitialize_defragmenter(&vk.defragmenter, vk.allocator);
+
+   vkDestroyShaderModule(vk.device, upscale_shader_module, get_host_allocator());
+   vkDestroyShaderModule(vk.device, vertex_shader_module, get_host_allocator());
+   vkDestroyShaderModule(vk.device, fragment_shader_module, get_host_allocator());
+   vkDestroyShaderModule(vk.device, vertex_mesh_shader_module, get_host_allocator());
+   vkDestroyShaderModule(vk.device, fragment_mesh_shader_module, get_host_allocator());
+   vkDestroyShaderModule(vk.device, vertex_resolve_shader_module, get_host_allocator());
+   vkDestroyShaderModule(vk.device, fragment_resolve_shader_module, get_host_allocator());
+
+   deinitialize_compute_effects(&vk.effects, vk.device);
+   vkDestroyPipeline(vk.device, vk.upscale_pipeline, get_host_allocator());
+   destroy_compute_kernel(&vk.luminance_kernel, vk.device);
+   vkDestroyPipeline(vk.device, vk.triangle_pipeline, get_host_allocator());
+   vkDestroyPipeline(vk.device, vk.mesh_pipeline, get_host_allocator());
+   vkDestroyPipeline(vk.device, vk.resolve_pipeline, get_host_allocator());
+
+   vkDestroySampler(vk.device, vk.linear_sampler, get_host_allocator());
+   vkDestroySampler(vk.device, vk.nearest_sampler, get_host_allocator());
+   deinitialize_bindless_descriptors(&vk.bindless, vk.device, vk.allocator);
+
+   destroy_render_target(&vk, &vk.background_image);
+   destroy_render_target(&vk, &vk.upscale_image);
+   destroy_render_target(&vk, &vk.draw_image);
 
-   vkDestroyImageView(vk.device, vk.draw_image.view, 0);
-   vmaDestroyImage(vk.allocator, vk.draw_image.image, vk.draw_image.allocation);
+   for(int frame_index = 0; frame_index < countof(vk.frame_commands); ++frame_index)
+   {
+      deinitialize_linear_buffer(&vk.frame_commands[frame_index].constants, vk.allocator);
+   }
 
    vmaDestroyAllocator(vk.allocator);
    for(int frame_index = 0; frame_index < countof(vk.frame_commands); ++frame_index)
    {
-      vkDestroyFence(vk.device, vk.frame_commands[frame_index].render_fence, 0);
-      vkDestroySemaphore(vk.device, vk.frame_commands[frame_index].render_semaphore, 0);
-      vkDestroySemaphore(vk.device, vk.frame_commands[frame_index].swapchain_semaphore, 0);
-      vkDestroyCommandPool(vk.device, vk.frame_commands[frame_index].pool, 0);
+      vkDestroyFence(vk.device, vk.frame_commands[frame_index].render_fence, get_host_allocator());
+      if(vk.timestamps_supported)
+      {
+         vkDestroyQueryPool(vk.device, vk.frame_commands[frame_index].timestamps, get_host_allocator());
+      }
+      vkDestroySemaphore(vk.device, vk.frame_commands[frame_index].render_semaphore, get_host_allocator());
+      vkDestroySemaphore(vk.device, vk.frame_commands[frame_index].swapchain_semaphore, get_host_allocator());
+      vkDestroyCommandPool(vk.device, vk.frame_commands[frame_index].pool, get_host_allocator());
+      for(u32 slice = 0; slice < vk.recording_slice_count; ++slice)
+      {
+         vkDestroyCommandPool(vk.device, vk.frame_commands[frame_index].slice_pools[slice], get_host_allocator());
+      }
+      deinitialize_descriptor_allocator(&vk.frame_commands[frame_index].descriptors, vk.device);
    }
-   vkDestroySwapchainKHR(vk.device, vk.swapchain, 0);
+   vkDestroySwapchainKHR(vk.device, vk.swapchain, get_host_allocator());
    for(int image_index = 0; image_index < vk.swapchain_image_count; ++image_index)
    {
-      vkDestroyImageView(vk.device, vk.swapchain_image_views[image_index], 0);
+      vkDestroyImageView(vk.device, vk.swapchain_image_views[image_index], get_host_allocator());
    }
+   // NOTE: SDL created the surface without our callbacks, so it has to be
+   // destroyed without them too.
    vkDestroySurfaceKHR(vk.instance, vk.surface, 0);
-   vkDestroyDevice(vk.device, 0);
+   vkDestroyDevice(vk.device, get_host_allocator());
+
+   deinitialize_jobs();
+
+   destroy_arena(&scratch);
+   destroy_arena(&arena);
 
    return(0);
 }
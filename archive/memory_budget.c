@@ -0,0 +1,78 @@
+#include "memory_budget.h"
+
+static u32 subsystem_allocations[MEMORY_SUBSYSTEM_COUNT];
+static VkDeviceSize subsystem_bytes[MEMORY_SUBSYSTEM_COUNT];
+
+void track_memory_allocation(VmaAllocator allocator, VmaAllocation allocation, memory_subsystem subsystem)
+{
+   assert(subsystem < MEMORY_SUBSYSTEM_COUNT);
+
+   vmaSetAllocationName(allocator, allocation, get_memory_subsystem_name(subsystem));
+
+   VmaAllocationInfo info;
+   vmaGetAllocationInfo(allocator, allocation, &info);
+   subsystem_allocations[subsystem]++;
+   subsystem_bytes[subsystem] += info.size;
+}
+
+void untrack_memory_allocation(VmaAllocator allocator, VmaAllocation allocation, memory_subsystem subsystem)
+{
+   assert(subsystem < MEMORY_SUBSYSTEM_COUNT);
+   assert(subsystem_allocations[subsystem] > 0);
+
+   VmaAllocationInfo info;
+   vmaGetAllocationInfo(allocator, allocation, &info);
+   subsystem_allocations[subsystem]--;
+   subsystem_bytes[subsystem] -= info.size;
+}
+
+void update_memory_budget(memory_budget *budget, VmaAllocator allocator)
+{
+   const VkPhysicalDeviceMemoryProperties *properties;
+   vmaGetMemoryProperties(allocator, &properties);
+
+   VmaBudget heap_budgets[VK_MAX_MEMORY_HEAPS];
+   vmaGetHeapBudgets(allocator, heap_budgets);
+
+   budget->heap_count = properties->memoryHeapCount;
+   budget->pressure = 0;
+   budget->device_local_usage = 0;
+   budget->device_local_budget = 0;
+   float device_local_pressure = -1.0f;
+   for(u32 heap_index = 0; heap_index < budget->heap_count; ++heap_index)
+   {
+      memory_heap_budget *heap = budget->heaps + heap_index;
+      heap->flags = properties->memoryHeaps[heap_index].flags;
+      heap->size = properties->memoryHeaps[heap_index].size;
+      heap->usage = heap_budgets[heap_index].usage;
+      heap->budget = heap_budgets[heap_index].budget;
+      heap->allocated = heap_budgets[heap_index].statistics.allocationBytes;
+
+      if(heap->budget > 0)
+      {
+         float pressure = (float)heap->usage / (float)heap->budget;
+         if(pressure > budget->pressure) budget->pressure = pressure;
+
+         if((heap->flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) && pressure > device_local_pressure)
+         {
+            device_local_pressure = pressure;
+            budget->device_local_usage = heap->usage;
+            budget->device_local_budget = heap->budget;
+         }
+      }
+   }
+
+   if(budget->pressure > budget->peak_pressure)
+   {
+      budget->peak_pressure = budget->pressure;
+   }
+
+   memcpy(budget->subsystem_allocations, subsystem_allocations, sizeof(subsystem_allocations));
+   memcpy(budget->subsystem_bytes, subsystem_bytes, sizeof(subsystem_bytes));
+}
+
+char *get_memory_subsystem_name(memory_subsystem subsystem)
+{
+   char *names[MEMORY_SUBSYSTEM_COUNT] = {"meshes", "render targets", "staging", "frame constants", "descriptors", "compute"};
+   return((subsystem < MEMORY_SUBSYSTEM_COUNT) ? names[subsystem] : "unknown");
+}
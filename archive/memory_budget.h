@@ -0,0 +1,16 @@
+#pragma once
+
+#include "vk.h"
+
+// NOTE: Above this fraction of a heap's budget the overlay flags the heap, and
+// allocating further is likely to start paging or failing.
+#define MEMORY_PRESSURE_WARNING 0.9f
+
+// NOTE: Every VMA allocation the renderer makes is named after the subsystem
+// that owns it and counted against that subsystem, so a heap filling up can
+// be traced back to whoever is responsible.
+void track_memory_allocation(VmaAllocator allocator, VmaAllocation allocation, memory_subsystem subsystem);
+void untrack_memory_allocation(VmaAllocator allocator, VmaAllocation allocation, memory_subsystem subsystem);
+
+void update_memory_budget(memory_budget *budget, VmaAllocator allocator);
+EXTERN_C char *get_memory_subsystem_name(memory_subsystem subsystem);
@@ -0,0 +1,289 @@
+#include "scene.h"
+#include "jobs.h"
+
+#define SCENE_UPDATE_BATCH_SIZE 1024
+
+void initialize_scene_transforms(scene_transforms *scene, memory_arena *arena, u32 capacity)
+{
+   memset(scene, 0, sizeof(*scene));
+   scene->capacity = capacity;
+
+   scene->position_x = allocate(arena, capacity, float);
+   scene->position_y = allocate(arena, capacity, float);
+   scene->position_z = allocate(arena, capacity, float);
+
+   scene->rotation_x = allocate(arena, capacity, float);
+   scene->rotation_y = allocate(arena, capacity, float);
+   scene->rotation_z = allocate(arena, capacity, float);
+   scene->rotation_w = allocate(arena, capacity, float);
+
+   scene->scale_x = allocate(arena, capacity, float);
+   scene->scale_y = allocate(arena, capacity, float);
+   scene->scale_z = allocate(arena, capacity, float);
+
+   scene->parents = allocate(arena, capacity, u32);
+   scene->depths = allocate(arena, capacity, u32);
+   scene->dirty = allocate(arena, capacity, u8);
+
+   scene->level_offsets = allocate(arena, capacity + 1, u32);
+
+   scene->node_to_slot = allocate(arena, capacity, u32);
+   scene->slot_to_node = allocate(arena, capacity, u32);
+
+   scene->world_matrices = allocate(arena, capacity, mat4);
+
+   scene->sort_floats = allocate(arena, capacity, float);
+   scene->sort_indices = allocate(arena, capacity + 1, u32);
+   scene->sort_scratch = allocate(arena, capacity + 1, u32);
+
+   scene->sorted = 1;
+}
+
+scene_node create_scene_node(scene_transforms *scene, scene_node parent)
+{
+   assert(scene->count < scene->capacity);
+
+   // NOTE: Nodes are never destroyed, so handles are handed out in order.
+   scene_node result = scene->count;
+   u32 slot = scene->count++;
+
+   scene->position_x[slot] = 0;
+   scene->position_y[slot] = 0;
+   scene->position_z[slot] = 0;
+
+   scene->rotation_x[slot] = 0;
+   scene->rotation_y[slot] = 0;
+   scene->rotation_z[slot] = 0;
+   scene->rotation_w[slot] = 1;
+
+   scene->scale_x[slot] = 1;
+   scene->scale_y[slot] = 1;
+   scene->scale_z[slot] = 1;
+
+   if(parent == SCENE_NO_PARENT)
+   {
+      scene->parents[slot] = SCENE_NO_PARENT;
+      scene->depths[slot] = 0;
+   }
+   else
+   {
+      assert(parent < result);
+      u32 parent_slot = scene->node_to_slot[parent];
+      scene->parents[slot] = parent_slot;
+      scene->depths[slot] = scene->depths[parent_slot] + 1;
+   }
+   scene->dirty[slot] = 1;
+
+   scene->node_to_slot[result] = slot;
+   scene->slot_to_node[slot] = result;
+
+   scene->sorted = 0;
+
+   return(result);
+}
+
+void set_scene_node_position(scene_transforms *scene, scene_node node, vec3 position)
+{
+   u32 slot = scene->node_to_slot[node];
+   scene->position_x[slot] = position.x;
+   scene->position_y[slot] = position.y;
+   scene->position_z[slot] = position.z;
+   scene->dirty[slot] = 1;
+}
+
+void set_scene_node_rotation(scene_transforms *scene, scene_node node, vec4 rotation)
+{
+   u32 slot = scene->node_to_slot[node];
+   scene->rotation_x[slot] = rotation.x;
+   scene->rotation_y[slot] = rotation.y;
+   scene->rotation_z[slot] = rotation.z;
+   scene->rotation_w[slot] = rotation.w;
+   scene->dirty[slot] = 1;
+}
+
+void set_scene_node_scale(scene_transforms *scene, scene_node node, vec3 scale)
+{
+   u32 slot = scene->node_to_slot[node];
+   scene->scale_x[slot] = scale.x;
+   scene->scale_y[slot] = scale.y;
+   scene->scale_z[slot] = scale.z;
+   scene->dirty[slot] = 1;
+}
+
+u32 get_scene_node_world_index(scene_transforms *scene, scene_node node)
+{
+   // NOTE: Only valid until the next node is created, since that can reorder
+   // slots during the following update.
+   return(scene->node_to_slot[node]);
+}
+
+static void permute_floats(scene_transforms *scene, float *values, u32 *old_to_new)
+{
+   for(u32 slot = 0; slot < scene->count; ++slot)
+   {
+      scene->sort_floats[old_to_new[slot]] = values[slot];
+   }
+   memcpy(values, scene->sort_floats, scene->count*sizeof(float));
+}
+
+static void sort_scene_transforms(scene_transforms *scene)
+{
+   u32 count = scene->count;
+
+   // Count nodes per hierarchy level.
+   scene->level_count = 0;
+   for(u32 slot = 0; slot < count; ++slot)
+   {
+      if(scene->depths[slot] + 1 > scene->level_count)
+      {
+         scene->level_count = scene->depths[slot] + 1;
+      }
+   }
+
+   u32 *level_offsets = scene->level_offsets;
+   memset(level_offsets, 0, (scene->level_count + 1)*sizeof(u32));
+   for(u32 slot = 0; slot < count; ++slot)
+   {
+      level_offsets[scene->depths[slot] + 1]++;
+   }
+   for(u32 level = 0; level < scene->level_count; ++level)
+   {
+      level_offsets[level + 1] += level_offsets[level];
+   }
+
+   // Stable counting sort by depth. Since a parent is always exactly one level
+   // above its children, this is a topological order.
+   u32 *cursors = scene->sort_scratch;
+   memcpy(cursors, level_offsets, scene->level_count*sizeof(u32));
+
+   u32 *old_to_new = scene->sort_indices;
+   for(u32 slot = 0; slot < count; ++slot)
+   {
+      old_to_new[slot] = cursors[scene->depths[slot]]++;
+   }
+
+   permute_floats(scene, scene->position_x, old_to_new);
+   permute_floats(scene, scene->position_y, old_to_new);
+   permute_floats(scene, scene->position_z, old_to_new);
+   permute_floats(scene, scene->rotation_x, old_to_new);
+   permute_floats(scene, scene->rotation_y, old_to_new);
+   permute_floats(scene, scene->rotation_z, old_to_new);
+   permute_floats(scene, scene->rotation_w, old_to_new);
+   permute_floats(scene, scene->scale_x, old_to_new);
+   permute_floats(scene, scene->scale_y, old_to_new);
+   permute_floats(scene, scene->scale_z, old_to_new);
+
+   u32 *scratch = scene->sort_scratch;
+   for(u32 slot = 0; slot < count; ++slot)
+   {
+      u32 parent = scene->parents[slot];
+      scratch[old_to_new[slot]] = (parent == SCENE_NO_PARENT) ? SCENE_NO_PARENT : old_to_new[parent];
+   }
+   memcpy(scene->parents, scratch, count*sizeof(u32));
+
+   for(u32 slot = 0; slot < count; ++slot)
+   {
+      scratch[old_to_new[slot]] = scene->depths[slot];
+   }
+   memcpy(scene->depths, scratch, count*sizeof(u32));
+
+   for(u32 slot = 0; slot < count; ++slot)
+   {
+      scratch[old_to_new[slot]] = scene->slot_to_node[slot];
+   }
+   memcpy(scene->slot_to_node, scratch, count*sizeof(u32));
+
+   for(u32 slot = 0; slot < count; ++slot)
+   {
+      scene->node_to_slot[scene->slot_to_node[slot]] = slot;
+   }
+
+   // NOTE: World matrices are not permuted, so every node is recomputed.
+   memset(scene->dirty, 1, count);
+   scene->sorted = 1;
+}
+
+static mat4 compose_local_matrix(scene_transforms *scene, u32 slot)
+{
+   float x = scene->rotation_x[slot];
+   float y = scene->rotation_y[slot];
+   float z = scene->rotation_z[slot];
+   float w = scene->rotation_w[slot];
+
+   float sx = scene->scale_x[slot];
+   float sy = scene->scale_y[slot];
+   float sz = scene->scale_z[slot];
+
+   mat4 result;
+   result.a.x = (1 - 2*(y*y + z*z)) * sx;
+   result.a.y = (2*(x*y + w*z)) * sx;
+   result.a.z = (2*(x*z - w*y)) * sx;
+   result.a.w = 0;
+
+   result.b.x = (2*(x*y - w*z)) * sy;
+   result.b.y = (1 - 2*(x*x + z*z)) * sy;
+   result.b.z = (2*(y*z + w*x)) * sy;
+   result.b.w = 0;
+
+   result.c.x = (2*(x*z + w*y)) * sz;
+   result.c.y = (2*(y*z - w*x)) * sz;
+   result.c.z = (1 - 2*(x*x + y*y)) * sz;
+   result.c.w = 0;
+
+   result.d.x = scene->position_x[slot];
+   result.d.y = scene->position_y[slot];
+   result.d.z = scene->position_z[slot];
+   result.d.w = 1;
+
+   return(result);
+}
+
+typedef struct {
+   scene_transforms *scene;
+   u32 first_slot;
+} scene_level_update;
+
+static void update_scene_level(void *data, u32 first, u32 last)
+{
+   scene_level_update *update = data;
+   scene_transforms *scene = update->scene;
+
+   for(u32 index = first; index < last; ++index)
+   {
+      u32 slot = update->first_slot + index;
+      u32 parent = scene->parents[slot];
+
+      // NOTE: Parents live on the previous level, so their dirty flags are
+      // final by the time this level runs.
+      b32 parent_changed = (parent != SCENE_NO_PARENT) && scene->dirty[parent];
+      if(scene->dirty[slot] || parent_changed)
+      {
+         mat4 local = compose_local_matrix(scene, slot);
+         scene->world_matrices[slot] = (parent == SCENE_NO_PARENT)
+            ? local
+            : mat4_multiply(scene->world_matrices[parent], local);
+
+         scene->dirty[slot] = 1;
+      }
+   }
+}
+
+void update_scene_transforms(scene_transforms *scene)
+{
+   if(!scene->sorted)
+   {
+      sort_scene_transforms(scene);
+   }
+
+   for(u32 level = 0; level < scene->level_count; ++level)
+   {
+      scene_level_update update = {0};
+      update.scene = scene;
+      update.first_slot = scene->level_offsets[level];
+
+      u32 level_size = scene->level_offsets[level + 1] - scene->level_offsets[level];
+      parallel_for(level_size, SCENE_UPDATE_BATCH_SIZE, update_scene_level, &update);
+   }
+
+   memset(scene->dirty, 0, scene->count);
+}
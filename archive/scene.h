@@ -0,0 +1,59 @@
+#pragma once
+
+#include "vk.h"
+
+#define SCENE_NO_PARENT 0xFFFFFFFF
+
+typedef u32 scene_node;
+
+typedef struct {
+   u32 count;
+   u32 capacity;
+
+   // NOTE: Local transform components are stored as structure-of-arrays, indexed
+   // by slot. Slots are kept sorted by hierarchy depth so that every parent
+   // precedes its children, and level n spans [level_offsets[n],
+   // level_offsets[n+1]).
+   float *position_x;
+   float *position_y;
+   float *position_z;
+
+   float *rotation_x;
+   float *rotation_y;
+   float *rotation_z;
+   float *rotation_w;
+
+   float *scale_x;
+   float *scale_y;
+   float *scale_z;
+
+   u32 *parents;
+   u32 *depths;
+   u8 *dirty;
+
+   u32 level_count;
+   u32 *level_offsets;
+   b32 sorted;
+
+   // NOTE: Node handles stay stable when slots are reordered.
+   u32 *node_to_slot;
+   u32 *slot_to_node;
+
+   // NOTE: World matrices are indexed by slot and laid out for direct upload
+   // to a GPU storage buffer.
+   mat4 *world_matrices;
+
+   float *sort_floats;
+   u32 *sort_indices;
+   u32 *sort_scratch;
+} scene_transforms;
+
+void initialize_scene_transforms(scene_transforms *scene, memory_arena *arena, u32 capacity);
+
+scene_node create_scene_node(scene_transforms *scene, scene_node parent);
+void set_scene_node_position(scene_transforms *scene, scene_node node, vec3 position);
+void set_scene_node_rotation(scene_transforms *scene, scene_node node, vec4 rotation);
+void set_scene_node_scale(scene_transforms *scene, scene_node node, vec3 scale);
+u32 get_scene_node_world_index(scene_transforms *scene, scene_node node);
+
+void update_scene_transforms(scene_transforms *scene);
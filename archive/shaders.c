@@ -0,0 +1,31 @@
+#include "shaders.h"
+#include "host_allocator.h"
+
+void load_shader_module(VkShaderModule *result, VkDevice device, memory_arena *arena, char *path)
+{
+   // NOTE: The SPIR-V only has to live until the module is created.
+   temporary_memory temp = begin_temp(arena);
+
+   FILE *shader_file = fopen(path, "rb");
+   assert(shader_file);
+
+   fseek(shader_file, 0, SEEK_END);
+   size_t shader_file_size = ftell(shader_file);
+   fseek(shader_file, 0, SEEK_SET);
+
+   memory_index count = shader_file_size / sizeof(u32);
+   u32 *shader_code = allocate(arena, count, u32);
+   assert(shader_code);
+
+   fread(shader_code, shader_file_size, 1, shader_file);
+   fclose(shader_file);
+
+   VkShaderModuleCreateInfo shader_module_info = {0};
+   shader_module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+   shader_module_info.codeSize = shader_file_size;
+   shader_module_info.pCode = shader_code;
+
+   VK_CHECK(vkCreateShaderModule(device, &shader_module_info, get_host_allocator(), result));
+
+   end_temp(temp);
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+#include "vk.h"
+
+void load_shader_module(VkShaderModule *result, VkDevice device, memory_arena *arena, char *path);
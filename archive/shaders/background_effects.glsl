@@ -0,0 +1,78 @@
+// NOTE: Shading for each background effect, shared by the standalone effect
+// shaders and the fused chain. Every function takes the colour produced by
+// the stages before it, which effects that cover the extent ignore.
+//
+// The effect shaders specialize their workgroup size per device, 16x16 unless
+// tuned, and only fill the extent drawn this frame, which can be smaller than
+// the image under dynamic resolution.
+
+#define BACKGROUND_EFFECT_NONE 0
+#define BACKGROUND_EFFECT_GRADIENT 1
+#define BACKGROUND_EFFECT_GRID 2
+#define BACKGROUND_EFFECT_SKY 3
+#define BACKGROUND_EFFECT_VIGNETTE 4
+
+vec4 gradient_effect(ivec2 coord, ivec2 size, vec4 color, vec4 top_color, vec4 bottom_color)
+{
+   float t = float(coord.y) / size.y;
+   return mix(top_color, bottom_color, t);
+}
+
+// NOTE: Lines every 16 texels. They come from the coordinate rather than the
+// workgroup, whose size is tuned per device.
+vec4 grid_effect(ivec2 coord, ivec2 size, vec4 color)
+{
+   vec4 result = vec4(0, 0, 0, 1);
+   if(coord.x % 16 != 0 && coord.y % 16 != 0)
+   {
+      result.x = float(coord.x) / size.x;
+      result.y = float(coord.y) / size.y;
+   }
+   return result;
+}
+
+float sky_hash(uvec2 value)
+{
+   value = value*uvec2(1664525u, 1013904223u);
+   value.x += value.y*1664525u;
+   value.y += value.x*1013904223u;
+   value ^= value >> 16u;
+   return float(value.x ^ value.y) * (1.0f/4294967296.0f);
+}
+
+// NOTE: sun is x, y in screen space, radius and star density.
+vec4 sky_effect(ivec2 coord, ivec2 size, vec4 color, vec4 zenith_color, vec4 horizon_color, vec4 sun, vec4 sun_color)
+{
+   vec2 uv = (vec2(coord) + 0.5f) / vec2(size);
+   float height = 1.0f - uv.y;
+
+   vec3 result = mix(horizon_color.rgb, zenith_color.rgb, sqrt(height));
+
+   // NOTE: Stars are a sparse hash over a fixed grid, fading out towards the
+   // horizon.
+   float star = sky_hash(uvec2(coord / 2));
+   if(star < sun.w*0.01f)
+   {
+      result += vec3(height*height);
+   }
+
+   // NOTE: A hard disc plus a wide falloff for the glow. The draw image is
+   // HDR, so the sun can be far brighter than the sky around it.
+   vec2 offset = (uv - sun.xy) * vec2(float(size.x) / float(size.y), 1.0f);
+   float distance = length(offset);
+   float radius = max(sun.z, 0.0001f);
+   float disc = 1.0f - smoothstep(0.8f*radius, radius, distance);
+   float glow = 0.05f*exp(-distance / (4.0f*radius));
+   result += sun_color.rgb * (disc + glow) * sun_color.a;
+
+   return vec4(result, 1.0f);
+}
+
+// NOTE: settings is strength, inner radius and outer radius.
+vec4 vignette_effect(ivec2 coord, ivec2 size, vec4 color, vec4 settings, vec4 tint)
+{
+   vec2 uv = (vec2(coord) + 0.5f) / vec2(size);
+   float distance = length((uv - 0.5f) * vec2(float(size.x) / float(size.y), 1.0f));
+   float amount = settings.x * smoothstep(settings.y, settings.z, distance);
+   return vec4(mix(color.rgb, tint.rgb, amount), color.a);
+}
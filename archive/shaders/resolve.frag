@@ -0,0 +1,152 @@
+#version 460
+#extension GL_EXT_nonuniform_qualifier : require
+
+#define TONEMAP_NONE 0
+#define TONEMAP_REINHARD 1
+#define TONEMAP_ACES 2
+
+layout(set = 0, binding = 1) uniform texture2D textures[];
+layout(set = 0, binding = 2) uniform sampler samplers[];
+
+layout(location = 0) in vec2 in_uv;
+layout(location = 0) out vec4 out_color;
+
+layout(push_constant) uniform constants
+{
+   vec2 source_scale;
+   float exposure;
+   uint tonemapper;
+   uint source_index;
+   uint sampler_index;
+   uint encode_srgb;
+   uint dither;
+   uint frame_index;
+   uint sharpen;
+   float sharpness;
+} push_constants;
+
+// NOTE: Largest negative lobe RCAS may apply, from AMD's FSR 1.
+#define RCAS_LIMIT (0.25f - (1.0f/16.0f))
+
+vec3 tonemap_aces(vec3 color)
+{
+   // NOTE: Narkowicz's fit of the ACES filmic curve.
+   const float a = 2.51f;
+   const float b = 0.03f;
+   const float c = 2.43f;
+   const float d = 0.59f;
+   const float e = 0.14f;
+   return clamp((color*(a*color + b)) / (color*(c*color + d) + e), 0.0f, 1.0f);
+}
+
+vec3 encode_srgb(vec3 color)
+{
+   vec3 low = color*12.92f;
+   vec3 high = 1.055f*pow(color, vec3(1.0f/2.4f)) - 0.055f;
+   return mix(high, low, lessThanEqual(color, vec3(0.0031308f)));
+}
+
+vec3 decode_srgb(vec3 color)
+{
+   vec3 low = color/12.92f;
+   vec3 high = pow((color + 0.055f)/1.055f, vec3(2.4f));
+   return mix(high, low, lessThanEqual(color, vec3(0.04045f)));
+}
+
+vec3 apply_tonemap(vec3 color)
+{
+   color *= push_constants.exposure;
+   if(push_constants.tonemapper == TONEMAP_REINHARD)
+   {
+      color = color / (1.0f + color);
+   }
+   else if(push_constants.tonemapper == TONEMAP_ACES)
+   {
+      color = tonemap_aces(color);
+   }
+   return clamp(color, 0.0f, 1.0f);
+}
+
+vec3 load_tonemapped(ivec2 coord, ivec2 last)
+{
+   coord = clamp(coord, ivec2(0), last);
+   vec3 color = texelFetch(sampler2D(textures[nonuniformEXT(push_constants.source_index)], samplers[nonuniformEXT(push_constants.sampler_index)]), coord, 0).rgb;
+   return apply_tonemap(color);
+}
+
+vec3 sharpen_rcas(ivec2 coord)
+{
+   // NOTE: Robust contrast adaptive sharpening, after AMD's FSR 1 RCAS. The
+   // source is the upscaled image at output resolution. The negative lobe on
+   // the cross neighbours is limited so that no channel can leave [0, 1].
+   ivec2 last = textureSize(sampler2D(textures[nonuniformEXT(push_constants.source_index)], samplers[nonuniformEXT(push_constants.sampler_index)]), 0) - 1;
+
+   //    b
+   //  d e f
+   //    h
+   vec3 b = load_tonemapped(coord + ivec2( 0, -1), last);
+   vec3 d = load_tonemapped(coord + ivec2(-1,  0), last);
+   vec3 e = load_tonemapped(coord, last);
+   vec3 f = load_tonemapped(coord + ivec2( 1,  0), last);
+   vec3 h = load_tonemapped(coord + ivec2( 0,  1), last);
+
+   vec3 lowest = min(min(b, d), min(f, h));
+   vec3 highest = max(max(b, d), max(f, h));
+
+   vec3 hit_min = lowest / (4.0f*highest + 1.0f/65536.0f);
+   vec3 hit_max = (1.0f - highest) / (4.0f*lowest - 4.0f - 1.0f/65536.0f);
+   vec3 lobe_rgb = max(-hit_min, hit_max);
+   float lobe = max(-RCAS_LIMIT, min(max(lobe_rgb.r, max(lobe_rgb.g, lobe_rgb.b)), 0.0f)) * push_constants.sharpness;
+
+   return clamp((lobe*(b + d + f + h) + e) / (4.0f*lobe + 1.0f), 0.0f, 1.0f);
+}
+
+float hash(uvec3 value)
+{
+   value = value*uvec3(1664525u, 1013904223u, 2654435769u);
+   value.x += value.y*value.z;
+   value.y += value.z*value.x;
+   value.z += value.x*value.y;
+   value ^= value >> 16u;
+   return float(value.x + value.y + value.z) * (1.0f/4294967296.0f);
+}
+
+void main(void)
+{
+   // NOTE: The draw image may be larger than the region drawn this frame, so
+   // only that region is stretched over the output. The far edge is pulled in
+   // by half a texel so bilinear filtering never reads stale pixels beyond it.
+   vec3 color;
+   if(push_constants.sharpen != 0)
+   {
+      color = sharpen_rcas(ivec2(gl_FragCoord.xy));
+   }
+   else
+   {
+      vec2 source_texel = 1.0f / vec2(textureSize(sampler2D(textures[nonuniformEXT(push_constants.source_index)], samplers[nonuniformEXT(push_constants.sampler_index)]), 0));
+      vec2 uv = min(in_uv*push_constants.source_scale, push_constants.source_scale - 0.5f*source_texel);
+      color = texture(sampler2D(textures[nonuniformEXT(push_constants.source_index)], samplers[nonuniformEXT(push_constants.sampler_index)]), uv).rgb;
+      color = apply_tonemap(color);
+   }
+
+   // NOTE: Triangular noise of one 8-bit step hides banding in gradients.
+   // The step is in encoded values, so the noise is added after the sRGB
+   // encode. sRGB swapchain formats encode on store, so for them the dithered
+   // colour is decoded again. Otherwise the encode happens here.
+   if(push_constants.dither != 0)
+   {
+      uvec3 seed = uvec3(gl_FragCoord.xy, push_constants.frame_index);
+      float noise = hash(seed) + hash(seed + uvec3(0, 0, 0x9e3779b9u)) - 1.0f;
+      color = clamp(encode_srgb(color) + noise*(1.0f/255.0f), 0.0f, 1.0f);
+      if(push_constants.encode_srgb == 0)
+      {
+         color = decode_srgb(color);
+      }
+   }
+   else if(push_constants.encode_srgb != 0)
+   {
+      color = encode_srgb(color);
+   }
+
+   out_color = vec4(color, 1.0f);
+}
@@ -0,0 +1,13 @@
+#version 450
+
+layout(location = 0) out vec2 out_uv;
+
+void main(void)
+{
+   // NOTE: A single triangle that covers the whole viewport, with uvs running
+   // 0..1 across the visible part.
+   vec2 uv = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+
+   gl_Position = vec4(uv*2.0f - 1.0f, 0.0f, 1.0f);
+   out_uv = uv;
+}
@@ -20,16 +20,30 @@ layout(buffer_reference, std430) readonly buffer vertex_buffer
    vertex vertices[];
 };
 
+layout(buffer_reference, std430) readonly buffer scene_buffer
+{
+   mat4 view_projection;
+};
+
+layout(buffer_reference, std430) readonly buffer transform_buffer
+{
+   mat4 world_matrices[];
+};
+
 layout(push_constant) uniform constants {
-   mat4 render_matrix;
+   scene_buffer scene_buffer;
    vertex_buffer vertex_buffer;
+   transform_buffer transform_buffer;
+   uint transform_index;
 } push_constants;
 
 void main(void)
 {
    vertex v = push_constants.vertex_buffer.vertices[gl_VertexIndex];
 
-   gl_Position = push_constants.render_matrix * vec4(v.position, 1);
+   mat4 world_matrix = push_constants.transform_buffer.world_matrices[push_constants.transform_index];
+
+   gl_Position = push_constants.scene_buffer.view_projection * world_matrix * vec4(v.position, 1);
    out_color = v.color.xyz;
    out_uv.x = v.uv_x;
    out_uv.y = v.uv_y;
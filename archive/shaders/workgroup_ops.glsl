@@ -0,0 +1,202 @@
+// NOTE: Workgroup-wide reductions and scans for 1D workgroups of
+// KERNEL_WORKGROUP_SIZE invocations, which every caller must be, in uniform
+// control flow. With USE_SUBGROUPS each subgroup works on its own values in
+// registers and only the per-subgroup totals go through shared memory. The
+// portable path does everything with shared memory trees.
+//
+// With USE_SUBGROUPS the including shader enables the subgroup extensions
+// itself: _basic and _arithmetic always, and _ballot to get the counting
+// functions.
+
+#define KERNEL_WORKGROUP_SIZE 256
+
+shared float workgroup_float_scratch[KERNEL_WORKGROUP_SIZE];
+shared uint workgroup_uint_scratch[KERNEL_WORKGROUP_SIZE];
+shared uint workgroup_uint_total;
+
+#ifdef USE_SUBGROUPS
+
+// NOTE: Pipelines are not created with full subgroups, so a subgroup may have
+// fewer invocations than gl_SubgroupSize. Totals are published by an elected
+// invocation, and loops over them step by the subgroup's active invocations.
+uint subgroup_active_count()
+{
+   return subgroupAdd(1u);
+}
+
+uint subgroup_active_rank()
+{
+   return subgroupExclusiveAdd(1u);
+}
+
+float workgroup_reduce_add(float value)
+{
+   float subgroup_sum = subgroupAdd(value);
+   if(subgroupElect())
+   {
+      workgroup_float_scratch[gl_SubgroupID] = subgroup_sum;
+   }
+   barrier();
+
+   float total = 0.0f;
+   for(uint index = subgroup_active_rank(); index < gl_NumSubgroups; index += subgroup_active_count())
+   {
+      total += workgroup_float_scratch[index];
+   }
+   total = subgroupAdd(total);
+   barrier();
+
+   return total;
+}
+
+float workgroup_reduce_max(float value)
+{
+   float subgroup_max = subgroupMax(value);
+   if(subgroupElect())
+   {
+      workgroup_float_scratch[gl_SubgroupID] = subgroup_max;
+   }
+   barrier();
+
+   float total = workgroup_float_scratch[0];
+   for(uint index = subgroup_active_rank(); index < gl_NumSubgroups; index += subgroup_active_count())
+   {
+      total = max(total, workgroup_float_scratch[index]);
+   }
+   total = subgroupMax(total);
+   barrier();
+
+   return total;
+}
+
+// NOTE: Turns each subgroup's total, which every invocation of the subgroup
+// passes in, into the sum of the totals of the subgroups before it, and the
+// sum of all of them.
+uint workgroup_scan_subgroup_totals(uint subgroup_total, out uint total)
+{
+   if(subgroupElect())
+   {
+      workgroup_uint_scratch[gl_SubgroupID] = subgroup_total;
+   }
+   barrier();
+
+   if(gl_SubgroupID == 0)
+   {
+      uint carry = 0;
+      uint rank = subgroup_active_rank();
+      uint active = subgroup_active_count();
+      for(uint base = 0; base < gl_NumSubgroups; base += active)
+      {
+         uint index = base + rank;
+         uint value = (index < gl_NumSubgroups) ? workgroup_uint_scratch[index] : 0;
+         uint inclusive = subgroupInclusiveAdd(value);
+         if(index < gl_NumSubgroups)
+         {
+            workgroup_uint_scratch[index] = carry + inclusive - value;
+         }
+         carry += subgroupAdd(value);
+      }
+      if(subgroupElect())
+      {
+         workgroup_uint_total = carry;
+      }
+   }
+   barrier();
+
+   uint result = workgroup_uint_scratch[gl_SubgroupID];
+   total = workgroup_uint_total;
+   barrier();
+
+   return result;
+}
+
+uint workgroup_exclusive_scan(uint value, out uint total)
+{
+   uint subgroup_offset = workgroup_scan_subgroup_totals(subgroupAdd(value), total);
+   return subgroup_offset + subgroupExclusiveAdd(value);
+}
+
+#ifdef GL_KHR_shader_subgroup_ballot
+// NOTE: How many invocations before this one have the predicate set, which
+// is where a compacting kernel writes its element.
+uint workgroup_exclusive_count(bool predicate, out uint total)
+{
+   uvec4 ballot = subgroupBallot(predicate);
+   uint subgroup_offset = workgroup_scan_subgroup_totals(subgroupBallotBitCount(ballot), total);
+   return subgroup_offset + subgroupBallotExclusiveBitCount(ballot);
+}
+#endif
+
+#else
+
+float workgroup_reduce_add(float value)
+{
+   uint index = gl_LocalInvocationIndex;
+   workgroup_float_scratch[index] = value;
+   barrier();
+
+   for(uint stride = KERNEL_WORKGROUP_SIZE/2; stride > 0; stride >>= 1)
+   {
+      if(index < stride)
+      {
+         workgroup_float_scratch[index] += workgroup_float_scratch[index + stride];
+      }
+      barrier();
+   }
+
+   float total = workgroup_float_scratch[0];
+   barrier();
+
+   return total;
+}
+
+float workgroup_reduce_max(float value)
+{
+   uint index = gl_LocalInvocationIndex;
+   workgroup_float_scratch[index] = value;
+   barrier();
+
+   for(uint stride = KERNEL_WORKGROUP_SIZE/2; stride > 0; stride >>= 1)
+   {
+      if(index < stride)
+      {
+         workgroup_float_scratch[index] = max(workgroup_float_scratch[index], workgroup_float_scratch[index + stride]);
+      }
+      barrier();
+   }
+
+   float total = workgroup_float_scratch[0];
+   barrier();
+
+   return total;
+}
+
+uint workgroup_exclusive_scan(uint value, out uint total)
+{
+   // NOTE: Hillis-Steele over shared memory. Every step reads before the
+   // barrier and writes after it, so no second buffer is needed.
+   uint index = gl_LocalInvocationIndex;
+   workgroup_uint_scratch[index] = value;
+   barrier();
+
+   for(uint offset = 1; offset < KERNEL_WORKGROUP_SIZE; offset <<= 1)
+   {
+      uint addend = (index >= offset) ? workgroup_uint_scratch[index - offset] : 0;
+      barrier();
+      workgroup_uint_scratch[index] += addend;
+      barrier();
+   }
+
+   uint inclusive = workgroup_uint_scratch[index];
+   total = workgroup_uint_scratch[KERNEL_WORKGROUP_SIZE - 1];
+   barrier();
+
+   return inclusive - value;
+}
+
+uint workgroup_exclusive_count(bool predicate, out uint total)
+{
+   return workgroup_exclusive_scan(predicate ? 1 : 0, total);
+}
+
+#endif
@@ -33,32 +33,41 @@ typedef uint8_t u8;
 typedef uint32_t u32;
 typedef uint64_t u64;
 
+typedef int64_t s64;
+
 typedef int32_t b32;
 
 #include <stddef.h>
 typedef ptrdiff_t memory_index;
 
-typedef struct {
-   char *begin;
-   char *end;
-} memory_arena;
+#include "arena.h"
 
-#define allocate(arena, count, type) (type *)allocate_(arena, count, sizeof(type), _Alignof(type))
+typedef struct {float x, y, z;} vec3;
+typedef struct {float x, y, z, w;} vec4;
+typedef struct {vec4 a, b, c, d;} mat4;
 
-static inline void *allocate_(memory_arena *arena, memory_index count, memory_index size, memory_index alignment)
+// NOTE: Matrices are column-major to match GLSL, so a, b, c and d are columns.
+static inline vec4 mat4_transform(mat4 m, vec4 v)
 {
-    memory_index padding = -(uintptr_t)arena->begin & (alignment - 1);
-    assert(count < (arena->end - arena->begin - padding)/size);
-
-    void *result = arena->begin + padding;
-    arena->begin += padding + count*size;
+   vec4 result;
+   result.x = m.a.x*v.x + m.b.x*v.y + m.c.x*v.z + m.d.x*v.w;
+   result.y = m.a.y*v.x + m.b.y*v.y + m.c.y*v.z + m.d.y*v.w;
+   result.z = m.a.z*v.x + m.b.z*v.y + m.c.z*v.z + m.d.z*v.w;
+   result.w = m.a.w*v.x + m.b.w*v.y + m.c.w*v.z + m.d.w*v.w;
 
-    return memset(result, 0, count*size);
+   return(result);
 }
 
-typedef struct {float x, y, z;} vec3;
-typedef struct {float x, y, z, w;} vec4;
-typedef struct {vec4 a, b, c, d;} mat4;
+static inline mat4 mat4_multiply(mat4 left, mat4 right)
+{
+   mat4 result;
+   result.a = mat4_transform(left, right.a);
+   result.b = mat4_transform(left, right.b);
+   result.c = mat4_transform(left, right.c);
+   result.d = mat4_transform(left, right.d);
+
+   return(result);
+}
 
 typedef struct {
    vec3 position;
@@ -72,20 +81,293 @@ typedef struct {
 
 typedef struct {
    vec4 data[4];
+   u32 image_index;
+   u32 extent_width;
+   u32 extent_height;
 } compute_push_constants;
 
 typedef struct {
-   mat4 world_matrix;
+   mat4 view_projection;
+} scene_constants;
+
+typedef enum {
+   TONEMAP_NONE,
+   TONEMAP_REINHARD,
+   TONEMAP_ACES,
+
+   TONEMAP_COUNT,
+} tonemap_operator;
+
+typedef struct {
+   float source_scale_x;
+   float source_scale_y;
+   float exposure;
+   u32 tonemapper;
+   u32 source_index;
+   u32 sampler_index;
+   u32 encode_srgb;
+   u32 dither;
+   u32 frame_index;
+   u32 sharpen;
+   float sharpness;
+} resolve_push_constants;
+
+typedef enum {
+   UPSCALER_BILINEAR,
+   UPSCALER_EASU,
+
+   UPSCALER_COUNT,
+} upscaler_mode;
+
+typedef struct {
+   float source_step_x;
+   float source_step_y;
+   u32 source_index;
+   u32 sampler_index;
+   u32 target_index;
+   u32 source_width;
+   u32 source_height;
+   u32 target_width;
+   u32 target_height;
+} upscale_push_constants;
+
+// NOTE: What the device's subgroups can do in compute shaders. Kernels with
+// a subgroup variant only get it when the device supports every operation
+// that variant uses, and fall back to shared memory otherwise.
+typedef struct {
+   u32 size;
+   VkSubgroupFeatureFlags operations;
+   b32 compute_supported;
+   b32 disabled;
+} subgroup_capabilities;
+
+typedef struct {
+   char *name;
+   VkSubgroupFeatureFlags required_operations;
+   b32 uses_subgroups;
+   VkShaderModule module;
+   VkPipeline pipeline;
+} compute_kernel;
+
+typedef enum {
+   LUMINANCE_REDUCE_IMAGE,
+   LUMINANCE_REDUCE_PARTIALS,
+} luminance_mode;
+
+typedef struct {
+   VkDeviceAddress partials;
+   VkDeviceAddress result;
+   u32 source_index;
+   u32 sampler_index;
+   u32 width;
+   u32 height;
+   u32 partial_count;
+   luminance_mode mode;
+} luminance_push_constants;
+
+typedef enum {
+   SCAN_MODE_EXCLUSIVE,
+   SCAN_MODE_COMPACT,
+} scan_mode;
+
+typedef struct {
+   VkDeviceAddress input;
+   VkDeviceAddress output;
+   VkDeviceAddress flags;
+   VkDeviceAddress status;
+   VkDeviceAddress total;
+   u32 count;
+   scan_mode mode;
+} scan_push_constants;
+
+typedef struct {
+   VkDeviceAddress keys_in;
+   VkDeviceAddress values_in;
+   VkDeviceAddress keys_out;
+   VkDeviceAddress values_out;
+   VkDeviceAddress histogram;
+   u32 count;
+   u32 tile_count;
+   u32 key_words;
+   u32 digit;
+   b32 has_values;
+} radix_sort_push_constants;
+
+typedef struct {
+   VkBuffer buffer;
+   VmaAllocation allocation;
+   void *memory;
+   VkDeviceAddress address;
+   VkDeviceSize size;
+} compute_buffer;
+
+// NOTE: Scan, compaction and sort on device buffers, all addressed by device
+// address. One scratch buffer holds the look-back tile states, the sort's
+// histograms and the other half of its ping-pong, sized for the largest
+// element count the primitives were initialized with.
+typedef struct {
+   compute_kernel scan;
+   compute_kernel radix_histogram;
+   compute_kernel radix_scatter;
+
+   u32 capacity;
+   compute_buffer scratch;
+   VkDeviceSize status_offset;
+   VkDeviceSize status_size;
+   VkDeviceSize total_offset;
+   VkDeviceSize histogram_offset;
+   VkDeviceSize keys_offset;
+   VkDeviceSize values_offset;
+} gpu_primitives;
+
+typedef struct {
+   float exposure;
+   tonemap_operator tonemapper;
+   b32 dither;
+
+   upscaler_mode upscaler;
+   // NOTE: Sharpness is in stops, so 0 is the strongest and each step up
+   // halves the effect.
+   float sharpness;
+} resolve_settings;
+
+typedef struct {
+   b32 enabled;
+   float target_ms;
+   float min_scale;
+   float max_scale;
+
+   float scale;
+   float gpu_ms;
+   float smoothed_gpu_ms;
+   u32 settle_frames;
+} dynamic_resolution;
+
+typedef struct {
+   VkDeviceAddress scene_buffer;
    VkDeviceAddress vertex_buffer;
+   VkDeviceAddress transform_buffer;
+   u32 transform_index;
 } mesh_push_constants;
 
+typedef struct {
+   u32 x;
+   u32 y;
+} workgroup_size;
+
+#define MAX_COMPUTE_EFFECTS 16
+#define MAX_COMPUTE_EFFECT_PIPELINES 32
+#define MAX_EFFECT_PARAMETERS 4
+#define MAX_EFFECT_CHAIN 4
+
+// NOTE: Matches the ids in shaders/background_effects.glsl. Effects with a
+// kind can be fused into a chain.
+typedef enum {
+   BACKGROUND_EFFECT_NONE,
+   BACKGROUND_EFFECT_GRADIENT,
+   BACKGROUND_EFFECT_GRID,
+   BACKGROUND_EFFECT_SKY,
+   BACKGROUND_EFFECT_VIGNETTE,
+} background_effect_kind;
+
+// NOTE: An effect that covers the extent writes every texel inside it, so
+// nothing has to be cleared first. Overlays instead modify whatever the
+// effects before them wrote.
+#define COMPUTE_EFFECT_COVERS_EXTENT (1 << 0)
+#define COMPUTE_EFFECT_OVERLAY (1 << 1)
+
+typedef enum {
+   EFFECT_PARAMETER_UNUSED,
+   EFFECT_PARAMETER_COLOR,
+   EFFECT_PARAMETER_VECTOR,
+} effect_parameter_type;
+
+// NOTE: Describes what one vec4 of compute_push_constants.data means to an
+// effect's shader, so the UI can present it sensibly.
 typedef struct {
    char *name;
+   effect_parameter_type type;
+   vec4 initial;
+} effect_parameter;
+
+typedef struct {
+   char *name;
+   char *shader_name;
+   background_effect_kind kind;
+   u32 flags;
+   b32 enabled;
+   effect_parameter parameters[MAX_EFFECT_PARAMETERS];
+
+   // NOTE: Low-frequency effects can be drawn at a half or a quarter of the
+   // draw extent and upsampled. The active effect decides for its chain.
+   u32 resolution_divisor;
+
+   // NOTE: The pipeline is only looked up the first time the effect is used,
+   // and is owned by the registry's cache rather than the effect.
    VkPipeline pipeline;
-   VkPipelineLayout layout;
+   workgroup_size workgroup;
    compute_push_constants constants;
+
+   float gpu_ms;
+   u64 timed_frame;
 } compute_effect;
 
+// NOTE: Specialization constants 0 and 1 are the workgroup size. A fused
+// chain also bakes in its stage count and the kind of each stage.
+typedef struct {
+   workgroup_size workgroup;
+   u32 stage_count;
+   u32 stage_kinds[MAX_EFFECT_CHAIN];
+} effect_specialization;
+
+typedef struct {
+   VkDeviceAddress parameters;
+   u32 image_index;
+   u32 extent_width;
+   u32 extent_height;
+} effect_chain_push_constants;
+
+typedef struct {
+   char *shader_name;
+   effect_specialization specialization;
+   VkShaderModule module;
+   b32 owns_module;
+   VkPipeline pipeline;
+} compute_effect_pipeline;
+
+typedef struct {
+   VkPipelineLayout layout;
+   VkPipelineCreateFlags pipeline_flags;
+   char *shader_suffix;
+
+   u32 effect_count;
+   compute_effect effects[MAX_COMPUTE_EFFECTS];
+   u32 active_effect;
+   b32 time_all_effects;
+
+   // NOTE: The active effect followed by every enabled overlay. With fusion
+   // on, the chain runs as a single dispatch of its own pipeline.
+   b32 fuse_chain;
+   u32 chain_length;
+   u32 chain[MAX_EFFECT_CHAIN];
+   compute_effect fused;
+   compute_effect upsample;
+
+   u32 pipeline_count;
+   compute_effect_pipeline pipelines[MAX_COMPUTE_EFFECT_PIPELINES];
+} compute_effect_registry;
+
+typedef enum {
+   MEMORY_SUBSYSTEM_MESHES,
+   MEMORY_SUBSYSTEM_RENDER_TARGETS,
+   MEMORY_SUBSYSTEM_STAGING,
+   MEMORY_SUBSYSTEM_FRAME_CONSTANTS,
+   MEMORY_SUBSYSTEM_DESCRIPTORS,
+   MEMORY_SUBSYSTEM_COMPUTE,
+
+   MEMORY_SUBSYSTEM_COUNT,
+} memory_subsystem;
+
 typedef struct {
    VkImage image;
    VkImageView view;
@@ -98,6 +380,9 @@ typedef struct {
     VkBuffer buffer;
     VmaAllocation allocation;
     VmaAllocationInfo info;
+    memory_subsystem subsystem;
+    VkDeviceSize size;
+    VkBufferUsageFlags usage;
 } vulkan_buffer;
 
 typedef struct {
@@ -108,22 +393,223 @@ typedef struct {
 typedef struct {
    char *name;
 
+   u32 surface_count;
    geometry_surface *surfaces;
 
    vulkan_buffer vertices;
    vulkan_buffer indices;
    VkDeviceAddress vertex_address;
+
+   vec3 bounds_center;
+   vec3 bounds_extent;
+
+   // NOTE: The CPU copy outlives the GPU buffers so an evicted mesh can be
+   // uploaded again the next time it is visible.
+   b32 resident;
+   u64 last_used_frame;
+   u32 vertex_count;
+   u32 index_count;
+   vertex *cpu_vertices;
+   u32 *cpu_indices;
 } vulkan_mesh;
 
+typedef struct {
+   // NOTE: Watermarks are fractions of the device-local budget. Passing the
+   // high one evicts least recently used meshes until usage drops under the
+   // low one.
+   float high_watermark;
+   float low_watermark;
+   VkDeviceSize upload_budget;
+
+   u32 resident_meshes;
+   VkDeviceSize resident_bytes;
+
+   u32 evictions;
+   u32 uploads;
+   u32 failed_allocations;
+   u32 deferred_draws;
+   VkDeviceSize uploaded_bytes;
+} residency_manager;
+
+#define MAX_RECORDING_SLICES 16
+
+typedef enum {
+   RENDER_PASS_OPAQUE,
+   RENDER_PASS_TRANSPARENT,
+} render_pass;
+
+typedef struct {
+   VkPipeline pipeline;
+   VkPipelineLayout layout;
+} vulkan_pipeline;
+
+typedef struct {
+   render_pass pass;
+   u32 pipeline_index;
+} vulkan_material;
+
+typedef struct {
+   u32 mesh_index;
+   u32 surface_index;
+   u32 material_index;
+   u32 scene_node;
+} render_object;
+
+typedef struct {
+   VkBuffer buffer;
+   VmaAllocation allocation;
+   u8 *memory;
+   VkDeviceAddress address;
+
+   VkDeviceSize size;
+   VkDeviceSize used;
+   VkDeviceSize peak;
+   VkDeviceSize alignment;
+} linear_buffer;
+
+typedef struct {
+   void *memory;
+   VkDeviceAddress address;
+   VkBuffer buffer;
+   VkDeviceSize offset;
+} linear_allocation;
+
+// NOTE: Indexed by VkSystemAllocationScope.
+#define HOST_ALLOCATION_SCOPE_COUNT 5
+
+typedef struct {
+   u64 live_count;
+   u64 live_bytes;
+   u64 peak_bytes;
+   u64 total_count;
+   u64 internal_bytes;
+} host_allocation_scope_stats;
+
+typedef struct {
+   host_allocation_scope_stats scopes[HOST_ALLOCATION_SCOPE_COUNT];
+   u64 pooled_allocations;
+} host_allocation_stats;
+
+typedef struct {
+   VkMemoryHeapFlags flags;
+   VkDeviceSize size;
+   VkDeviceSize usage;
+   VkDeviceSize budget;
+   VkDeviceSize allocated;
+} memory_heap_budget;
+
+typedef struct {
+   // NOTE: Without VK_EXT_memory_budget, VMA estimates usage from its own
+   // allocations and the budget as a fraction of the heap size.
+   b32 budget_extension;
+
+   u32 heap_count;
+   memory_heap_budget heaps[VK_MAX_MEMORY_HEAPS];
+   float pressure;
+   float peak_pressure;
+
+   // NOTE: The most pressured device-local heap, which is where meshes and
+   // render targets live.
+   VkDeviceSize device_local_usage;
+   VkDeviceSize device_local_budget;
+
+   u32 subsystem_allocations[MEMORY_SUBSYSTEM_COUNT];
+   VkDeviceSize subsystem_bytes[MEMORY_SUBSYSTEM_COUNT];
+} memory_budget;
+
+#define MAX_DEFRAGMENTATION_MOVES 64
+
+typedef struct {
+   // NOTE: Meshes are allocated from their own pool so defragmentation only
+   // ever sees allocations it knows how to move.
+   VmaPool pool;
+   VmaDefragmentationContext context;
+
+   b32 requested;
+   b32 active;
+   b32 pass_pending;
+   u64 pass_frame;
+   VmaDefragmentationPassMoveInfo pass;
+
+   u32 retired_buffer_count;
+   VkBuffer retired_buffers[MAX_DEFRAGMENTATION_MOVES];
+
+   VkDeviceSize block_bytes;
+   VkDeviceSize allocation_bytes;
+
+   u32 runs;
+   u32 passes;
+   VmaDefragmentationStats last_run;
+} mesh_defragmenter;
+
+#define MAX_DESCRIPTOR_POOL_RATIOS 8
+#define MAX_DESCRIPTOR_POOLS 32
+
+typedef struct {
+   VkDescriptorType type;
+   float ratio;
+} descriptor_pool_ratio;
+
+typedef struct {
+   u32 allocated_sets;
+   u32 pool_count;
+   u32 pools_used;
+   u32 peak_sets;
+} descriptor_allocator_stats;
+
+typedef struct {
+   u32 ratio_count;
+   descriptor_pool_ratio ratios[MAX_DESCRIPTOR_POOL_RATIOS];
+   u32 sets_per_pool;
+
+   u32 full_pool_count;
+   VkDescriptorPool full_pools[MAX_DESCRIPTOR_POOLS];
+
+   u32 ready_pool_count;
+   VkDescriptorPool ready_pools[MAX_DESCRIPTOR_POOLS];
+
+   descriptor_allocator_stats stats;
+} descriptor_allocator;
+
 typedef struct {
    VkCommandPool pool;
    VkCommandBuffer commands;
 
+   VkCommandPool slice_pools[MAX_RECORDING_SLICES];
+   VkCommandBuffer slice_commands[MAX_RECORDING_SLICES];
+
+   linear_buffer constants;
+
+   descriptor_allocator descriptors;
+
+   // NOTE: Two timestamps bracket the frame's command buffer, followed by a
+   // pair per compute effect dispatched. They are only read back once the
+   // slot's fence has signalled.
+   VkQueryPool timestamps;
+   b32 timestamps_written;
+   u32 timed_effect_count;
+   u32 timed_effects[MAX_COMPUTE_EFFECTS + 2];
+
+   // NOTE: Where this frame's luminance reduction lands in its constants.
+   linear_allocation luminance;
+   b32 luminance_written;
+
    VkSemaphore swapchain_semaphore;
    VkSemaphore render_semaphore;
    VkFence render_fence;
 } vulkan_frame_commands;
 
+typedef struct {
+   u32 recorded_calls;
+   u32 elided_pipeline_binds;
+   u32 elided_descriptor_binds;
+   u32 elided_index_buffer_binds;
+   u32 elided_viewports;
+   u32 elided_scissors;
+   u32 elided_push_constants;
+   u32 push_constant_bytes_saved;
+} command_recorder_stats;
+
 typedef struct {
    VkPipelineShaderStageCreateInfo shader_stages[2];
    VkPipelineInputAssemblyStateCreateInfo input_assembly;
@@ -134,8 +620,39 @@ typedef struct {
    VkPipelineDepthStencilStateCreateInfo depth_stencil;
    VkPipelineRenderingCreateInfo rendering_info;
    VkFormat color_attachment_format;
+   VkPipelineCreateFlags flags;
 } vulkan_pipeline_configuration;
 
+typedef struct {
+   VkDescriptorSetLayout layout;
+   VkDescriptorPool pool;
+   VkDescriptorSet set;
+   VkPipelineLayout pipeline_layout;
+
+   u32 storage_image_count;
+   u32 storage_image_capacity;
+   u32 sampled_image_count;
+   u32 sampled_image_capacity;
+   u32 sampler_count;
+   u32 sampler_capacity;
+
+   // NOTE: With VK_EXT_descriptor_buffer the set lives in a mapped buffer
+   // instead of a pool, and descriptors are written into it directly.
+   b32 use_descriptor_buffer;
+   VkPipelineCreateFlags pipeline_flags;
+
+   VkBuffer descriptor_buffer;
+   VmaAllocation descriptor_buffer_allocation;
+   u8 *descriptor_buffer_memory;
+   VkDeviceAddress descriptor_buffer_address;
+   VkBufferUsageFlags descriptor_buffer_usage;
+
+   VkDeviceSize binding_offsets[3];
+   size_t descriptor_sizes[3];
+
+   PFN_vkGetDescriptorEXT get_descriptor;
+} bindless_descriptors;
+
 typedef struct {
    VkInstance instance;
    VkPhysicalDevice gpu;
@@ -154,19 +671,70 @@ typedef struct {
 
    u64 frame_count;
    vulkan_frame_commands frame_commands[2];
+   u32 recording_slice_count;
 
    VkQueue graphics_queue;
    VkQueue present_queue;
 
    VmaAllocator allocator;
    vulkan_image draw_image;
+   char *draw_image_format_name;
    VkExtent2D draw_extent;
+   dynamic_resolution resolution;
+
+   vulkan_image upscale_image;
+   u32 upscale_image_index;
+   u32 upscale_image_sampled_index;
+
+   vulkan_image background_image;
+   u32 background_image_index;
+   u32 background_image_sampled_index;
+
+   b32 timestamps_supported;
+   float timestamp_period;
+
+   bindless_descriptors bindless;
+   u32 draw_image_index;
+   u32 draw_image_sampled_index;
+   VkSampler linear_sampler;
+   VkSampler nearest_sampler;
+   u32 linear_sampler_index;
+   u32 nearest_sampler_index;
 
    VkFence immediate_fence;
    VkCommandBuffer immediate_command_buffer;
 
-   compute_effect background_effect;
+   compute_effect_registry effects;
    VkPipeline triangle_pipeline;
    VkPipeline mesh_pipeline;
-   VkPipelineLayout mesh_pipeline_layout;
+   VkPipeline resolve_pipeline;
+   VkPipeline upscale_pipeline;
+   resolve_settings resolve;
+
+   subgroup_capabilities subgroups;
+   compute_kernel luminance_kernel;
+   float average_luminance;
+   float max_luminance;
+
+   u32 pipeline_count;
+   vulkan_pipeline pipelines[64];
+
+   u32 material_count;
+   vulkan_material materials[256];
+
+   u32 mesh_count;
+   vulkan_mesh meshes[256];
+
+   command_recorder_stats recorder_stats;
+   descriptor_allocator_stats descriptor_stats;
+   VkAllocationCallbacks *host_allocator;
+   host_allocation_stats host_stats;
+   memory_budget memory;
+   residency_manager residency;
+   mesh_defragmenter defragmenter;
+   memory_arena *permanent_arena;
+   memory_arena *scratch_arena;
+
+   VkDeviceSize frame_constants_used;
+   VkDeviceSize frame_constants_peak;
 } vulkan_context;
@@ -6,8 +6,9 @@
 #include "dependencies/imgui_impl_vulkan.h"
 
 #include "vk.h"
+#include "memory_budget.h"
 
-static VkDescriptorPool imgui_pool;
+#define IMGUI_TEXTURE_DESCRIPTORS 8
 
 EXTERN_C bool create_window(vulkan_context *vk, char *title, int width, int height)
 {
@@ -37,6 +38,23 @@ EXTERN_C bool get_window_dimensions(vulkan_context *vk, int *width, int *height)
    return(result);
 }
 
+static void edit_effect_parameters(compute_effect *effect)
+{
+   for(u32 parameter_index = 0; parameter_index < MAX_EFFECT_PARAMETERS; ++parameter_index)
+   {
+      effect_parameter *parameter = effect->parameters + parameter_index;
+      float *value = (float *)(effect->constants.data + parameter_index);
+      if(parameter->type == EFFECT_PARAMETER_COLOR)
+      {
+         ImGui::ColorEdit4(parameter->name, value, ImGuiColorEditFlags_Float|ImGuiColorEditFlags_HDR);
+      }
+      else if(parameter->type == EFFECT_PARAMETER_VECTOR)
+      {
+         ImGui::InputFloat4(parameter->name, value);
+      }
+   }
+}
+
 EXTERN_C bool window_should_close(vulkan_context *vk)
 {
    bool result = false;
@@ -56,12 +74,226 @@ EXTERN_C bool window_should_close(vulkan_context *vk)
 
    if(ImGui::Begin("background"))
    {
-      compute_effect *effect = &vk->background_effect;
-      ImGui::Text("Effect: %s", effect->name);
-      ImGui::InputFloat4("data[0]", (float *)(effect->constants.data + 0));
-      ImGui::InputFloat4("data[1]", (float *)(effect->constants.data + 1));
-      ImGui::InputFloat4("data[2]", (float *)(effect->constants.data + 2));
-      ImGui::InputFloat4("data[3]", (float *)(effect->constants.data + 3));
+      compute_effect_registry *registry = &vk->effects;
+      compute_effect *active = registry->effects + registry->active_effect;
+      if(ImGui::BeginCombo("effect", active->name))
+      {
+         for(u32 effect_index = 0; effect_index < registry->effect_count; ++effect_index)
+         {
+            if(registry->effects[effect_index].flags & COMPUTE_EFFECT_OVERLAY)
+            {
+               continue;
+            }
+
+            bool selected = (effect_index == registry->active_effect);
+            if(ImGui::Selectable(registry->effects[effect_index].name, selected))
+            {
+               registry->active_effect = effect_index;
+            }
+         }
+         ImGui::EndCombo();
+      }
+
+      active = registry->effects + registry->active_effect;
+
+      const char *qualities[] = {"full", "half", "quarter"};
+      int quality = (active->resolution_divisor >= 4) ? 2 : (active->resolution_divisor >= 2) ? 1 : 0;
+      ImGui::Combo("quality", &quality, qualities, countof(qualities));
+      active->resolution_divisor = 1u << quality;
+
+      edit_effect_parameters(active);
+
+      for(u32 effect_index = 0; effect_index < registry->effect_count; ++effect_index)
+      {
+         compute_effect *overlay = registry->effects + effect_index;
+         if(overlay->flags & COMPUTE_EFFECT_OVERLAY)
+         {
+            ImGui::PushID(overlay->name);
+            bool enabled = overlay->enabled;
+            ImGui::Checkbox(overlay->name, &enabled);
+            overlay->enabled = enabled;
+            if(enabled)
+            {
+               edit_effect_parameters(overlay);
+            }
+            ImGui::PopID();
+         }
+      }
+
+      bool fuse_chain = registry->fuse_chain;
+      bool time_all = registry->time_all_effects;
+      ImGui::Separator();
+      ImGui::Checkbox("fuse chain", &fuse_chain);
+      ImGui::Checkbox("time all effects", &time_all);
+      registry->fuse_chain = fuse_chain;
+      registry->time_all_effects = time_all;
+
+      compute_effect *extra_timings[] = {&registry->fused, &registry->upsample};
+      for(u32 effect_index = 0; effect_index < registry->effect_count + countof(extra_timings); ++effect_index)
+      {
+         compute_effect *effect = (effect_index < registry->effect_count)
+            ? registry->effects + effect_index
+            : extra_timings[effect_index - registry->effect_count];
+         b32 current = (effect->timed_frame + 8 >= vk->frame_count);
+         if(effect->timed_frame && vk->timestamps_supported)
+         {
+            ImGui::Text("%-12s %ux%u %7.3f ms%s", effect->name, effect->workgroup.x, effect->workgroup.y,
+                        effect->gpu_ms, current ? "" : " (stale)");
+         }
+         else
+         {
+            ImGui::Text("%-12s %ux%u       -", effect->name, effect->workgroup.x, effect->workgroup.y);
+         }
+      }
+   }
+   ImGui::End();
+
+   if(ImGui::Begin("resolve"))
+   {
+      const char *tonemappers[TONEMAP_COUNT] = {"none", "reinhard", "aces"};
+      int tonemapper = vk->resolve.tonemapper;
+      bool dither = vk->resolve.dither;
+
+      ImGui::SliderFloat("exposure", &vk->resolve.exposure, 0.0f, 8.0f);
+      ImGui::Combo("tonemapper", &tonemapper, tonemappers, TONEMAP_COUNT);
+      ImGui::Checkbox("dither", &dither);
+
+      const char *upscalers[UPSCALER_COUNT] = {"bilinear", "easu + rcas"};
+      int upscaler = vk->resolve.upscaler;
+      ImGui::Combo("upscaler", &upscaler, upscalers, UPSCALER_COUNT);
+      ImGui::SliderFloat("sharpness (stops)", &vk->resolve.sharpness, 0.0f, 2.0f);
+
+      vk->resolve.tonemapper = (tonemap_operator)tonemapper;
+      vk->resolve.dither = dither;
+      vk->resolve.upscaler = (upscaler_mode)upscaler;
+
+      ImGui::Separator();
+      ImGui::Text("luminance: %.3f average, %.3f peak", vk->average_luminance, vk->max_luminance);
+   }
+   ImGui::End();
+
+   if(ImGui::Begin("resolution"))
+   {
+      dynamic_resolution *resolution = &vk->resolution;
+      bool enabled = resolution->enabled;
+
+      ImGui::Checkbox("dynamic", &enabled);
+      ImGui::SliderFloat("target ms", &resolution->target_ms, 4.0f, 50.0f);
+      ImGui::SliderFloat("min scale", &resolution->min_scale, 0.25f, 1.0f);
+      ImGui::SliderFloat("max scale", &resolution->max_scale, 0.25f, 1.0f);
+      if(resolution->max_scale < resolution->min_scale)
+      {
+         resolution->max_scale = resolution->min_scale;
+      }
+      resolution->enabled = enabled;
+
+      if(vk->timestamps_supported)
+      {
+         ImGui::Text("GPU frame: %.2f ms (smoothed %.2f ms)", resolution->gpu_ms, resolution->smoothed_gpu_ms);
+      }
+      else
+      {
+         ImGui::Text("GPU timestamps unavailable");
+      }
+      ImGui::Text("Scale: %.2f", resolution->scale);
+      ImGui::Text("Draw extent: %ux%u of %ux%u", vk->draw_extent.width, vk->draw_extent.height,
+                  vk->draw_image.extent.width, vk->draw_image.extent.height);
+   }
+   ImGui::End();
+
+   if(ImGui::Begin("renderer"))
+   {
+      command_recorder_stats *stats = &vk->recorder_stats;
+      u32 elided = stats->elided_pipeline_binds + stats->elided_descriptor_binds + stats->elided_index_buffer_binds +
+         stats->elided_viewports + stats->elided_scissors + stats->elided_push_constants;
+
+      ImGui::Text("Draw format: %s", vk->draw_image_format_name);
+      ImGui::Text("Compute kernels: %s (subgroup size %u)", vk->luminance_kernel.uses_subgroups ? "subgroup" : "portable", vk->subgroups.size);
+      ImGui::Text("Descriptors: %s", vk->bindless.use_descriptor_buffer ? "descriptor buffer" : "descriptor sets");
+      ImGui::Text("Recorded calls: %u", stats->recorded_calls);
+      ImGui::Text("Elided calls: %u", elided);
+      ImGui::Text("  pipelines: %u", stats->elided_pipeline_binds);
+      ImGui::Text("  descriptor sets: %u", stats->elided_descriptor_binds);
+      ImGui::Text("  index buffers: %u", stats->elided_index_buffer_binds);
+      ImGui::Text("  viewports: %u", stats->elided_viewports);
+      ImGui::Text("  scissors: %u", stats->elided_scissors);
+      ImGui::Text("  push constants: %u", stats->elided_push_constants);
+      ImGui::Text("Push constant bytes saved: %u", stats->push_constant_bytes_saved);
+
+      descriptor_allocator_stats *descriptors = &vk->descriptor_stats;
+      ImGui::Separator();
+      ImGui::Text("Frame descriptor sets: %u (peak %u)", descriptors->allocated_sets, descriptors->peak_sets);
+      ImGui::Text("Descriptor pools: %u used, %u total", descriptors->pools_used, descriptors->pool_count);
+      ImGui::Text("Frame constants: %.1f KiB (peak %.1f KiB)", vk->frame_constants_used/1024.0, vk->frame_constants_peak/1024.0);
+
+      memory_arena *permanent = vk->permanent_arena;
+      memory_arena *scratch = vk->scratch_arena;
+      ImGui::Separator();
+      ImGui::Text("Permanent arena: %.1f KiB used, %.1f KiB committed", permanent->used/1024.0, permanent->committed/1024.0);
+      ImGui::Text("Scratch arena: %.1f KiB used, %.1f KiB high water", scratch->used/1024.0, scratch->high_water/1024.0);
+
+      const char *scope_names[HOST_ALLOCATION_SCOPE_COUNT] = {"command", "object", "cache", "device", "instance"};
+      host_allocation_stats *host = &vk->host_stats;
+      ImGui::Separator();
+      ImGui::Text("Driver host allocations (%llu pooled)", (unsigned long long)host->pooled_allocations);
+      for(u32 scope = 0; scope < HOST_ALLOCATION_SCOPE_COUNT; ++scope)
+      {
+         host_allocation_scope_stats *stats = host->scopes + scope;
+         ImGui::Text("  %-8s %6llu live, %8.1f KiB (peak %.1f KiB), %llu total",
+                     scope_names[scope], (unsigned long long)stats->live_count, stats->live_bytes/1024.0,
+                     stats->peak_bytes/1024.0, (unsigned long long)stats->total_count);
+      }
+   }
+   ImGui::End();
+
+   if(ImGui::Begin("memory"))
+   {
+      memory_budget *memory = &vk->memory;
+      ImGui::Text("Budget source: %s", memory->budget_extension ? "VK_EXT_memory_budget" : "estimated");
+      ImGui::Text("Pressure: %.0f%% (peak %.0f%%)", 100.0f*memory->pressure, 100.0f*memory->peak_pressure);
+
+      for(u32 heap_index = 0; heap_index < memory->heap_count; ++heap_index)
+      {
+         memory_heap_budget *heap = memory->heaps + heap_index;
+         float fraction = (heap->budget > 0) ? (float)heap->usage / (float)heap->budget : 0.0f;
+
+         char overlay[64];
+         snprintf(overlay, sizeof(overlay), "%.1f / %.1f MiB", heap->usage/(1024.0*1024.0), heap->budget/(1024.0*1024.0));
+
+         ImGui::Separator();
+         ImGui::Text("Heap %u (%s, %.0f MiB)", heap_index, (heap->flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? "device local" : "host",
+                     heap->size/(1024.0*1024.0));
+         if(fraction > MEMORY_PRESSURE_WARNING) ImGui::PushStyleColor(ImGuiCol_PlotHistogram, ImVec4(0.9f, 0.2f, 0.2f, 1.0f));
+         ImGui::ProgressBar(fraction, ImVec2(-1.0f, 0.0f), overlay);
+         if(fraction > MEMORY_PRESSURE_WARNING) ImGui::PopStyleColor();
+         ImGui::Text("  allocated by us: %.1f MiB", heap->allocated/(1024.0*1024.0));
+      }
+
+      ImGui::Separator();
+      for(u32 subsystem = 0; subsystem < MEMORY_SUBSYSTEM_COUNT; ++subsystem)
+      {
+         ImGui::Text("%-16s %4u allocations, %8.1f MiB", get_memory_subsystem_name((memory_subsystem)subsystem),
+                     memory->subsystem_allocations[subsystem], memory->subsystem_bytes[subsystem]/(1024.0*1024.0));
+      }
+
+      residency_manager *residency = &vk->residency;
+      ImGui::Separator();
+      ImGui::Text("Resident meshes: %u of %u (%.1f MiB)", residency->resident_meshes, vk->mesh_count, residency->resident_bytes/(1024.0*1024.0));
+      ImGui::Text("Streamed this frame: %.1f KiB, %u draws deferred", residency->uploaded_bytes/1024.0, residency->deferred_draws);
+      ImGui::Text("Evictions: %u, uploads: %u, failed allocations: %u", residency->evictions, residency->uploads, residency->failed_allocations);
+
+      mesh_defragmenter *defragmenter = &vk->defragmenter;
+      VmaDefragmentationStats *last_run = &defragmenter->last_run;
+      ImGui::Separator();
+      ImGui::Text("Mesh pool: %.1f MiB in blocks, %.1f MiB allocated", defragmenter->block_bytes/(1024.0*1024.0),
+                  defragmenter->allocation_bytes/(1024.0*1024.0));
+      ImGui::Text("Defragmentation: %s, %u runs, %u passes", defragmenter->active ? "running" : "idle", defragmenter->runs, defragmenter->passes);
+      ImGui::Text("Last run: %u moved (%.1f KiB), %.1f KiB freed, %u blocks freed",
+                  last_run->allocationsMoved, last_run->bytesMoved/1024.0, last_run->bytesFreed/1024.0, last_run->deviceMemoryBlocksFreed);
+      if(ImGui::Button("Defragment") && !defragmenter->active)
+      {
+         defragmenter->requested = true;
+      }
    }
    ImGui::End();
 
@@ -72,29 +304,6 @@ EXTERN_C bool window_should_close(vulkan_context *vk)
 
 EXTERN_C void initialize_imgui(vulkan_context *vk)
 {
-   VkDescriptorPoolSize pool_sizes[] = {
-      {VK_DESCRIPTOR_TYPE_SAMPLER, 1000},
-      {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1000},
-      {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1000},
-      {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1000},
-      {VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 1000},
-      {VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 1000},
-      {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1000},
-      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1000},
-      {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1000},
-      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1000},
-      {VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1000}
-   };
-
-   VkDescriptorPoolCreateInfo pool_info = {};
-   pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-   pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
-   pool_info.maxSets = 1000;
-   pool_info.poolSizeCount = countof(pool_sizes);
-   pool_info.pPoolSizes = pool_sizes;
-
-   VK_CHECK(vkCreateDescriptorPool(vk->device, &pool_info, 0, &imgui_pool));
-
    ImGui::CreateContext();
 
    ImGui_ImplSDL3_InitForVulkan((SDL_Window *)vk->window);
@@ -104,7 +313,11 @@ EXTERN_C void initialize_imgui(vulkan_context *vk)
    init_info.PhysicalDevice = vk->gpu;
    init_info.Device = vk->device;
    init_info.Queue = vk->graphics_queue;
-   init_info.DescriptorPool = imgui_pool;
+   init_info.Allocator = vk->host_allocator;
+   // NOTE: ImGui only ever needs combined image samplers for its font atlas
+   // and any textures we register with it, so let the backend size and own
+   // its pool instead of reserving every descriptor type up front.
+   init_info.DescriptorPoolSize = IMGUI_IMPL_VULKAN_MINIMUM_IMAGE_SAMPLER_POOL_SIZE + IMGUI_TEXTURE_DESCRIPTORS;
    init_info.MinImageCount = 3;
    init_info.ImageCount = 3;
    init_info.UseDynamicRendering = true;
@@ -112,7 +325,7 @@ EXTERN_C void initialize_imgui(vulkan_context *vk)
    init_info.PipelineRenderingCreateInfo = {};
    init_info.PipelineRenderingCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
    init_info.PipelineRenderingCreateInfo.colorAttachmentCount = 1;
-   init_info.PipelineRenderingCreateInfo.pColorAttachmentFormats = &vk->draw_image.format;
+   init_info.PipelineRenderingCreateInfo.pColorAttachmentFormats = &vk->swapchain_image_format;
    init_info.MSAASamples = VK_SAMPLE_COUNT_1_BIT;
 
    ImGui_ImplVulkan_Init(&init_info);
@@ -147,5 +360,4 @@ EXTERN_C void draw_imgui(vulkan_context *vk, VkCommandBuffer cmd, VkImageView ta
 EXTERN_C void deinitialize_imgui(vulkan_context *vk)
 {
    ImGui_ImplVulkan_Shutdown();
-   vkDestroyDescriptorPool(vk->device, imgui_pool, 0);
 }
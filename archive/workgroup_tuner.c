@@ -0,0 +1,114 @@
+#include "workgroup_tuner.h"
+
+u32 get_workgroup_candidates(VkPhysicalDeviceLimits *limits, workgroup_size *candidates, u32 max_count)
+{
+   // NOTE: Square tiles suit texture caches, wide rows suit devices that
+   // execute a workgroup as one long vector.
+   workgroup_size sizes[] = {
+      {8, 8}, {16, 8}, {8, 16}, {16, 16}, {32, 8}, {32, 16},
+      {32, 32}, {64, 1}, {64, 4}, {128, 1}, {256, 1}, {4, 4},
+   };
+
+   u32 result = 0;
+   for(u32 size_index = 0; size_index < countof(sizes) && result < max_count; ++size_index)
+   {
+      workgroup_size size = sizes[size_index];
+      if(size.x <= limits->maxComputeWorkGroupSize[0] &&
+         size.y <= limits->maxComputeWorkGroupSize[1] &&
+         size.x*size.y <= limits->maxComputeWorkGroupInvocations)
+      {
+         candidates[result++] = size;
+      }
+   }
+
+   return(result);
+}
+
+static b32 parse_workgroup_line(char *line, VkPhysicalDeviceProperties *properties, char *effect_name, workgroup_size *result)
+{
+   u32 vendor_id, device_id, driver_version;
+   char name[64];
+   workgroup_size size;
+
+   b32 matched = 0;
+   if(sscanf(line, "%u %u %u %63s %u %u", &vendor_id, &device_id, &driver_version, name, &size.x, &size.y) == 6 &&
+      vendor_id == properties->vendorID &&
+      device_id == properties->deviceID &&
+      driver_version == properties->driverVersion &&
+      strcmp(name, effect_name) == 0)
+   {
+      matched = 1;
+      if(result)
+      {
+         *result = size;
+      }
+   }
+
+   return(matched);
+}
+
+b32 load_workgroup_size(char *path, VkPhysicalDeviceProperties *properties, char *effect_name, workgroup_size *result)
+{
+   b32 found = 0;
+
+   FILE *file = fopen(path, "r");
+   if(file)
+   {
+      char line[256];
+      while(!found && fgets(line, sizeof(line), file))
+      {
+         found = parse_workgroup_line(line, properties, effect_name, result);
+      }
+      fclose(file);
+   }
+
+   return(found);
+}
+
+void save_workgroup_size(char *path, VkPhysicalDeviceProperties *properties, char *effect_name, workgroup_size size)
+{
+   // NOTE: Entries for other devices and effects are carried over, and a stale
+   // entry for this one is replaced. The file is tiny, so it is simply read
+   // whole and rewritten.
+   char *contents = 0;
+   size_t contents_size = 0;
+
+   FILE *file = fopen(path, "r");
+   if(file)
+   {
+      fseek(file, 0, SEEK_END);
+      long file_size = ftell(file);
+      fseek(file, 0, SEEK_SET);
+
+      contents = malloc(file_size + 1);
+      contents_size = fread(contents, 1, file_size, file);
+      contents[contents_size] = 0;
+      fclose(file);
+   }
+
+   file = fopen(path, "w");
+   if(!file)
+   {
+      fprintf(stderr, "Failed to write workgroup sizes to %s.\n", path);
+      free(contents);
+      return;
+   }
+
+   if(contents)
+   {
+      char *line = strtok(contents, "\n");
+      while(line)
+      {
+         if(!parse_workgroup_line(line, properties, effect_name, 0))
+         {
+            fprintf(file, "%s\n", line);
+         }
+         line = strtok(0, "\n");
+      }
+      free(contents);
+   }
+
+   fprintf(file, "%u %u %u %s %u %u\n", properties->vendorID, properties->deviceID, properties->driverVersion,
+           effect_name, size.x, size.y);
+   fclose(file);
+}
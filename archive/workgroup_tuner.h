@@ -0,0 +1,19 @@
+#pragma once
+
+#include "vk.h"
+
+// NOTE: Compute effects take their workgroup size from specialization
+// constants 0 and 1. The best size depends on the device (wide SIMD on a
+// discrete GPU, a handful of CPU threads on lavapipe), so it can be measured
+// once per device and kept in a small text file, one line per effect:
+//
+//    <vendor id> <device id> <driver version> <effect name> <x> <y>
+#define WORKGROUP_SIZES_PATH "workgroup_sizes.txt"
+#define MAX_WORKGROUP_CANDIDATES 16
+#define DEFAULT_WORKGROUP_SIZE_X 16
+#define DEFAULT_WORKGROUP_SIZE_Y 16
+
+u32 get_workgroup_candidates(VkPhysicalDeviceLimits *limits, workgroup_size *candidates, u32 max_count);
+
+b32 load_workgroup_size(char *path, VkPhysicalDeviceProperties *properties, char *effect_name, workgroup_size *result);
+void save_workgroup_size(char *path, VkPhysicalDeviceProperties *properties, char *effect_name, workgroup_size size);